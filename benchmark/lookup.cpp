@@ -1,5 +1,11 @@
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
 #include <numeric>
 #include <print>
 #include <vector>
@@ -8,6 +14,22 @@
 #include "hoshidicts/lookup.hpp"
 #include "hoshidicts/query.hpp"
 
+namespace {
+std::atomic<uint64_t> allocations{0};
+}
+
+// counts every heap allocation of the process
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
 int main(int argc, char** argv) {
   if (argc < 4) {
     std::println(stderr, "{} <dict_path> <word> <iterations>", argv[0]);
@@ -23,14 +45,26 @@ int main(int argc, char** argv) {
   Deinflector deinflector;
   Lookup lookup(query, deinflector);
 
+  // one arena reused by every iteration, release() keeps the initial buffer
+  std::vector<std::byte> buffer(1 << 20);
+  std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
   std::vector<double> durations;
+  uint64_t arena_allocations = 0;
+  uint64_t default_allocations = 0;
   for (int i = 0; i < iterations; ++i) {
+    uint64_t before = allocations.load(std::memory_order_relaxed);
     const auto start = std::chrono::high_resolution_clock::now();
-    const auto results = lookup.lookup(word);
+    const auto results = lookup.lookup(word, &arena);
     const auto end = std::chrono::high_resolution_clock::now();
+    arena_allocations += allocations.load(std::memory_order_relaxed) - before;
+    arena.release();
 
     const std::chrono::duration<double, std::milli> elapsed = end - start;
     durations.push_back(elapsed.count());
+
+    before = allocations.load(std::memory_order_relaxed);
+    lookup.lookup(word);
+    default_allocations += allocations.load(std::memory_order_relaxed) - before;
   }
 
   if (durations.empty()) {
@@ -46,6 +80,8 @@ int main(int argc, char** argv) {
   std::println("avg: {:.2f}ms", average);
   std::println("min: {:.2f}ms", *min);
   std::println("max: {:.2f}ms", *max);
+  std::println("allocations per lookup: {} (reused arena), {} (default)", arena_allocations / iterations,
+               default_allocations / iterations);
 
   return 0;
 }
@@ -21,9 +21,9 @@ void print_usage(const char* program) {
   std::println("{} import <path/to/dictionary.zip>", program);
   std::println("{} deinflect <word>", program);
   std::println("{} preprocess <word>", program);
-  std::println("{} query <path/to/dictionary> <word>", program);
-  std::println("{} lookup <path/to/dictionary> <lookup_string>", program);
-  std::println("{} freq <path/to/dictionary> <word>", program);
+  std::println("{} query <path/to/dictionary.hoshidict> <word>", program);
+  std::println("{} lookup <path/to/dictionary.hoshidict> <lookup_string>", program);
+  std::println("{} freq <path/to/dictionary.hoshidict> <word>", program);
 }
 
 void cmd_import(const std::string& path) {
@@ -60,7 +60,7 @@ void cmd_deinflect(const std::string& inflected) {
     if (!r.trace.empty()) {
       std::print("  ");
       for (size_t i = 0; i < r.trace.size(); ++i) {
-        std::print("{}{}", r.trace[i].name, i < r.trace.size() - 1 ? " -> " : "");
+        std::print("{}{}", r.trace[i]->name, i < r.trace.size() - 1 ? " -> " : "");
       }
       std::println("");
     }
@@ -119,9 +119,11 @@ void cmd_freq(const std::string& path, const std::string& expression, const std:
 void cmd_lookup(const std::vector<std::string>& db_paths, const std::string& lookup_string, int max_results = 8,
                 int scan_length = 16) {
   DictionaryQuery dict_query;
+  std::vector<DictionarySource> sources;
   for (const auto& path : db_paths) {
-    dict_query.add_term_dict(path);
+    sources.push_back(DictionarySource{.path = path});
   }
+  dict_query.add_dicts(sources);
   Deinflector deinflect;
   Lookup lookup(dict_query, deinflect);
   auto result = lookup.lookup(lookup_string, max_results, scan_length);
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -10,16 +12,20 @@ struct TransformGroup {
 };
 
 struct DeinflectionResult {
-  std::string text;
+  std::pmr::string text;
   uint32_t conditions;
-  std::vector<TransformGroup> trace;
+  // points into the deinflector's transform groups
+  std::pmr::vector<const TransformGroup*> trace;
 };
 
 class Deinflector {
  public:
   Deinflector();
-  std::vector<DeinflectionResult> deinflect(const std::string& text) const;
+  std::pmr::vector<DeinflectionResult> deinflect(
+      std::string_view text, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
   static uint32_t pos_to_conditions(const std::vector<std::string>& part_of_speech);
+  // part of speech tags separated by ascii whitespace, as found in term rules. doesn't allocate
+  static uint32_t pos_to_conditions(std::string_view part_of_speech);
 
  private:
   struct Rule {
@@ -56,8 +62,14 @@ class Deinflector {
     V = V1 | V5 | VK | VS | VZ,
   };
 
-  void deinflect_recursive(const std::string& text, uint32_t conditions, std::vector<TransformGroup>& trace,
-                           std::vector<DeinflectionResult>& results) const;
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+  };
+
+  static uint32_t pos_to_condition(std::string_view part_of_speech);
+  void deinflect_recursive(std::string_view text, uint32_t conditions, std::pmr::vector<const TransformGroup*>& trace,
+                           std::pmr::vector<DeinflectionResult>& results) const;
 
   void init_transforms();
 
@@ -65,7 +77,8 @@ class Deinflector {
   void add_rule(const Rule& rule);
   void add_irregular(std::string_view suffix, uint32_t conditions_in, uint32_t conditions_out, int group_id);
 
-  std::unordered_map<std::string, std::vector<Rule>> transforms_;
+  // heterogeneous lookup, suffixes are looked up without copying them
+  std::unordered_map<std::string, std::vector<Rule>, StringHash, std::equal_to<>> transforms_;
   std::vector<TransformGroup> groups_;
   size_t max_length_;
 };
\ No newline at end of file
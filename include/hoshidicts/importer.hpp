@@ -13,6 +13,20 @@ struct ImportResult {
   std::vector<std::string> errors;
 };
 
+struct ImportOptions {
+  bool low_ram = false;
+  // upper bound in bytes for the buffered (key, record) pairs of the key index build, also used for the suffixes of
+  // suffix_index. keys are sorted in runs on disk once it is exceeded, and sorted keys and finished key indexes are
+  // streamed to disk. the hash and slot tables grow with the unique key count, around 40 bytes per key, and are not
+  // covered. 0 keeps the whole index in memory, or uses a small default budget with low_ram
+  size_t index_memory_budget = 0;
+  // index every suffix of every term key for suffix and wildcard queries, grows the key index a few times over
+  bool suffix_index = false;
+  // build an inverted index from glossary words to term records for DictionaryQuery::search_glossary
+  bool glossary_index = false;
+};
+
 namespace dictionary_importer {
 ImportResult import(const std::string& zip_path, const std::string& output_dir, bool low_ram = false);
+ImportResult import(const std::string& zip_path, const std::string& output_dir, const ImportOptions& options);
 };
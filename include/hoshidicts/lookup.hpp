@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory_resource>
 #include <string>
 #include <vector>
 
@@ -19,9 +20,12 @@ class Lookup {
   Lookup(DictionaryQuery& query, Deinflector& deinflector) : query_(query), deinflector_(deinflector) {};
   std::vector<LookupResult> lookup(const std::string& lookup_string, int max_results = 16,
                                    size_t scan_length = 16) const;
+  // everything but the returned results is allocated from arena, which can be released once lookup returns
+  std::vector<LookupResult> lookup(const std::string& lookup_string, std::pmr::memory_resource* arena,
+                                   int max_results = 16, size_t scan_length = 16) const;
 
  private:
-  static void filter_by_pos(std::vector<TermResult>& terms, const DeinflectionResult& d);
+  static bool matches_pos(const TermView& term, const DeinflectionResult& d);
 
   DictionaryQuery& query_;
   Deinflector& deinflector_;
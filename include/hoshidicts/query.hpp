@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct Frequency {
@@ -14,11 +19,28 @@ struct DictionaryStyle {
   std::string styles;
 };
 
+struct DictionaryTag {
+  std::string name;
+  std::string category;
+  int order;
+  std::string notes;
+  int score;
+};
+
+// location of a compressed glossary, decompressed by DictionaryQuery::materialize
+struct GlossaryHandle {
+  uint32_t dict_index = 0;
+  uint64_t offset = 0;
+  uint32_t size = 0;
+};
+
 struct GlossaryEntry {
   std::string dict_name;
+  // empty until materialized if the query was lazy
   std::string glossary;
-  std::string definition_tags;
-  std::string term_tags;
+  std::vector<DictionaryTag> definition_tags;
+  std::vector<DictionaryTag> term_tags;
+  GlossaryHandle handle;
 };
 
 struct FrequencyEntry {
@@ -26,9 +48,24 @@ struct FrequencyEntry {
   std::vector<Frequency> frequencies;
 };
 
+struct PitchAccent {
+  int position;
+  std::vector<int> nasal;
+  std::vector<int> devoice;
+  std::vector<DictionaryTag> tags;
+};
+
 struct PitchEntry {
   std::string dict_name;
   std::vector<int> pitch_positions;
+  std::vector<PitchAccent> pitches;
+};
+
+struct GlossaryCacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  size_t size_bytes;
+  size_t entries;
 };
 
 struct TermResult {
@@ -40,6 +77,108 @@ struct TermResult {
   std::vector<PitchEntry> pitches;
 };
 
+// tag ids of a record in the mapping, resolved against the dictionary's tag table when iterated
+struct TagsView {
+  const uint8_t* ids = nullptr;
+  uint8_t count = 0;
+  const std::vector<DictionaryTag>* table = nullptr;
+
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (uint8_t i = 0; i < count; i++) {
+      uint16_t id;
+      std::memcpy(&id, ids + i * sizeof(uint16_t), sizeof(uint16_t));
+      if (id < table->size()) {
+        fn((*table)[id]);
+      }
+    }
+  }
+};
+
+struct GlossaryView {
+  std::string_view dict_name;
+  GlossaryHandle handle;
+  TagsView definition_tags;
+  TagsView term_tags;
+};
+
+struct FrequencyView {
+  std::string_view dict_name;
+  // position among the frequency dictionaries in the order they were added, titles can repeat
+  uint32_t dict_index = 0;
+  int value;
+  // empty if the dictionary has no display value
+  std::string_view display_value;
+};
+
+struct PitchView {
+  std::string_view dict_name;
+  int position;
+  std::span<const uint8_t> nasal;
+  std::span<const uint8_t> devoice;
+  TagsView tags;
+};
+
+// frequencies and pitches are listed per dictionary in the order dictionaries were added
+struct TermView {
+  std::string_view expression;
+  std::string_view reading;
+  std::string_view rules;
+  std::span<const GlossaryView> glossaries;
+  std::span<const FrequencyView> frequencies;
+  std::span<const PitchView> pitches;
+};
+
+// storage of view queries. views point into the mapped dictionaries or into the context and stay valid until the
+// context is cleared or destroyed, or dictionaries are added to the query. with a monotonic resource, the context
+// doesn't have to be cleared before the resource is released
+class QueryContext {
+ public:
+  explicit QueryContext(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+  ~QueryContext();
+
+  QueryContext(const QueryContext&) = delete;
+  QueryContext& operator=(const QueryContext&) = delete;
+
+  QueryContext(QueryContext&&) noexcept;
+  QueryContext& operator=(QueryContext&&) noexcept;
+
+  void clear();
+
+ private:
+  friend class DictionaryQuery;
+  struct Impl;
+  std::unique_ptr<Impl> ptr_;
+};
+
+class GlossaryCache;
+
+// how much of a dictionary is brought into memory when it is added. stronger policies trade load time and memory
+// for the latency of the first lookups, which otherwise fault in the key index page by page
+enum class Residency : uint8_t {
+  // pages are read on first access
+  lazy,
+  // the whole file is read in while it is mapped
+  populate,
+  // the key index is read ahead in the background
+  willneed_index,
+  // the key index is read in and locked in memory, falls back to willneed_index beyond RLIMIT_MEMLOCK
+  lock_index,
+  // the key index is read ahead and backed by transparent huge pages where the kernel supports it for files
+  huge_pages,
+};
+
+enum class DictionaryKind : uint8_t { term, frequency, pitch };
+
+struct DictionarySource {
+  std::string path;
+  DictionaryKind kind = DictionaryKind::term;
+  Residency residency = Residency::lazy;
+  // add_dicts only maps the file and reads its title and styles, the rest is loaded in parallel in the background.
+  // queries of the dictionary kind wait for it, residency policies for the key index are applied then
+  bool lazy_load = false;
+};
+
 class DictionaryQuery {
  public:
   DictionaryQuery();
@@ -51,17 +190,64 @@ class DictionaryQuery {
   DictionaryQuery(DictionaryQuery&&) noexcept;
   DictionaryQuery& operator=(DictionaryQuery&&) noexcept;
 
-  void add_term_dict(const std::string& path);
-  void add_freq_dict(const std::string& path);
-  void add_pitch_dict(const std::string& path);
+  void add_term_dict(const std::string& path, Residency residency = Residency::lazy);
+  void add_freq_dict(const std::string& path, Residency residency = Residency::lazy);
+  void add_pitch_dict(const std::string& path, Residency residency = Residency::lazy);
+  // loads dictionaries in parallel and adds them in the order of sources, files that fail to open are skipped
+  void add_dicts(std::span<const DictionarySource> sources);
+  // builds one index over the keys of all dictionaries of a kind, rebuilt whenever dictionaries are added. like
+  // adding dictionaries it must not run concurrently with queries
+  void set_merged_index(bool enabled);
+  // faults in the key index of every dictionary, so that first lookups don't wait for the disk. waits for lazily
+  // added dictionaries to load first. can run on a background thread while queries run, but not while dictionaries
+  // are added
+  void warm() const;
 
   void query_freq(std::vector<TermResult>& terms) const;
   void query_pitch(std::vector<TermResult>& terms) const;
 
-  std::vector<TermResult> query(const std::string& expression) const;
+  // with materialize = false glossaries are left compressed, only their handles are set
+  std::vector<TermResult> query(const std::string& expression, bool materialize = true) const;
+  // same results as query without copying, repeated calls append to the context
+  std::span<const TermView> query_view(std::string_view expression, QueryContext& context) const;
+  TermResult to_result(const TermView& view, bool materialize = true) const;
+  // terms of every expression in expressions order. all keys are hashed and their slots, posting lists and records
+  // prefetched before anything is decoded
+  std::pmr::vector<std::span<const TermView>> query_batch(std::span<const std::string_view> expressions,
+                                                         QueryContext& context) const;
+  std::vector<std::vector<TermResult>> query_batch(std::span<const std::string_view> expressions,
+                                                   bool materialize = true) const;
+  // expressions and readings starting with prefix in key order, at most limit keys over all term dictionaries
+  std::vector<std::string> prefix_query(std::string_view prefix, size_t limit) const;
+  // keys in [first, last), an empty last has no upper bound
+  std::vector<std::string> range_query(std::string_view first, std::string_view last, size_t limit) const;
+  // keys matching pattern, * matches any sequence and ? a single character. without a leading literal, patterns are
+  // answered from the suffix index of ImportOptions::suffix_index or fall back to scanning all keys
+  std::vector<std::string> wildcard_query(std::string_view pattern, size_t limit) const;
+  // terms of the same keys, one span per key
+  std::pmr::vector<std::span<const TermView>> prefix_query(std::string_view prefix, size_t limit,
+                                                          QueryContext& context) const;
+  std::pmr::vector<std::span<const TermView>> range_query(std::string_view first, std::string_view last,
+                                                         size_t limit, QueryContext& context) const;
+  std::pmr::vector<std::span<const TermView>> wildcard_query(std::string_view pattern, size_t limit,
+                                                            QueryContext& context) const;
+  // terms whose glossaries contain every word of query, at most limit terms. terms are ranked by the first frequency
+  // dictionary listing them, in the order frequency dictionaries were added, and unlisted terms come last.
+  // only dictionaries imported with ImportOptions::glossary_index are searched
+  std::vector<TermResult> search_glossary(std::string_view query, size_t limit, bool materialize = true) const;
+  std::span<const TermView> search_glossary(std::string_view query, size_t limit, QueryContext& context) const;
+  void materialize(GlossaryEntry& entry) const;
+  void materialize(TermResult& term) const;
+  // decompresses into out, reusing its capacity
+  bool get_glossary(const GlossaryHandle& handle, std::string& out) const;
+
+  // caches decompressed glossaries up to byte_budget, 0 disables the cache
+  void set_glossary_cache(size_t byte_budget);
+  GlossaryCacheStats get_glossary_cache_stats() const;
 
   std::vector<char> get_media_file(const std::string& dict_name, const std::string& media_path) const;
   std::vector<DictionaryStyle> get_styles() const;
+  std::vector<DictionaryTag> get_tags(const std::string& dict_name) const;
   std::vector<std::string> get_freq_dict_order() const;
 
  private:
@@ -72,11 +258,58 @@ class DictionaryQuery {
     std::unique_ptr<DictionaryData> data;
   };
   enum DictionaryType : uint8_t { TERM, FREQ, PITCH };
+  struct MergedIndex;
+  struct MergedIndexes;
+  struct PendingLoads;
+  struct KeyPostings;
 
-  void add_dict(const std::string& path, DictionaryType);
+  // maps a dictionary and reads its name and styles, false if it isn't a dictionary of the kind
+  static bool open_dict(const std::string& path, DictionaryType type, Residency residency, Dictionary& dict);
+  // loads everything queries read, the expensive part of adding a dictionary
+  static bool load_dict(DictionaryData& data, DictionaryType type, Residency residency);
+  void append_dict(DictionaryType type, Dictionary&& dict);
+  void add_dict(const std::string& path, DictionaryType, Residency residency);
+  // loaded dictionaries of a kind, waits for lazily added ones that are still loading
+  const std::vector<Dictionary>& dicts(DictionaryType type) const;
+  // dictionaries of a kind, lazily added ones may not be loaded yet
+  const std::vector<Dictionary>& registered_dicts(DictionaryType type) const;
+  std::vector<const DictionaryData*> dict_data(DictionaryType type) const;
+  void build_merged_index(DictionaryType type);
+  // null while the kind has no merged index, lazily added dictionaries publish theirs after loading
+  const MergedIndex* merged_index(DictionaryType type) const;
+  // calls fn(dict, posting list) for every dictionary of a kind containing key, in the order they were added
+  template <typename Fn>
+  void for_each_postings(DictionaryType type, std::string_view key, Fn&& fn) const;
+  // posting list of key k in dictionary d at k * dictionary count + d, nullptr if absent
+  std::pmr::vector<const uint8_t*> find_postings_batch(DictionaryType type, std::span<const std::string_view> keys,
+                                                       std::pmr::memory_resource* resource) const;
+  // keys in [first, last) with their posting lists, sorted by key and dictionary
+  std::vector<KeyPostings> find_range(std::string_view first, std::string_view last, size_t limit) const;
+  std::vector<KeyPostings> find_pattern(std::string_view pattern, size_t limit) const;
+  std::pmr::vector<std::span<const TermView>> key_terms(const std::vector<KeyPostings>& matches,
+                                                        QueryContext& context) const;
+  // builds the terms of expression from for_each_record(fn), which passes (dict, record offset) to fn in dictionary
+  // order. records of other keys are skipped, an empty expression keeps every record
+  template <typename Fn>
+  std::span<const TermView> make_terms(std::string_view expression, QueryContext& context, Fn&& for_each_record) const;
+  // calls fn(dict, value, display value address) for the frequency records of a term in dictionary order
+  template <typename Fn>
+  void for_each_frequency(std::string_view expression, std::string_view reading, Fn&& fn) const;
+  void find_frequencies(std::string_view expression, std::string_view reading,
+                        std::pmr::vector<FrequencyView>& out) const;
+  void find_pitches(std::string_view expression, std::string_view reading, std::pmr::vector<PitchView>& out) const;
+  // (frequency dictionary index, smallest value) of the first frequency dictionary in frequencies with a
+  // non-negative value
+  std::pair<size_t, int32_t> frequency_rank(std::span<const FrequencyView> frequencies) const;
+  // same rank read straight from the frequency records of a term
+  std::pair<size_t, int32_t> frequency_rank(std::string_view expression, std::string_view reading) const;
 
-  static std::string decompress_glossary(const void* data, size_t size);
+  static bool decompress_glossary(const DictionaryData& dict, uint64_t offset, uint32_t size, std::string& out);
+  // first, so move assignment waits for background loads before replacing the dictionaries they write to
+  std::unique_ptr<PendingLoads> pending_;
   std::vector<Dictionary> term_dicts_;
   std::vector<Dictionary> freq_dicts_;
   std::vector<Dictionary> pitch_dicts_;
+  std::unique_ptr<MergedIndexes> merged_;
+  std::unique_ptr<GlossaryCache> glossary_cache_;
 };
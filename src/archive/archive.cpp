@@ -0,0 +1,264 @@
+#include "archive.hpp"
+
+#define MINIZ_HEADER_FILE_ONLY
+#include <miniz.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+constexpr uint32_t EOCD_SIGNATURE = 0x06054b50;
+constexpr uint32_t ZIP64_EOCD_LOCATOR_SIGNATURE = 0x07064b50;
+constexpr uint32_t ZIP64_EOCD_SIGNATURE = 0x06064b50;
+constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+constexpr uint16_t ZIP64_EXTRA_ID = 0x0001;
+
+constexpr size_t EOCD_SIZE = 22;
+constexpr size_t ZIP64_EOCD_LOCATOR_SIZE = 20;
+constexpr size_t ZIP64_EOCD_SIZE = 56;
+constexpr size_t CENTRAL_HEADER_SIZE = 46;
+constexpr size_t LOCAL_HEADER_SIZE = 30;
+constexpr size_t MAX_COMMENT_SIZE = 0xffff;
+
+constexpr uint16_t METHOD_STORED = 0;
+constexpr uint16_t METHOD_DEFLATED = 8;
+
+template <typename T>
+T load(const uint8_t* addr) {
+  T result;
+  std::memcpy(&result, addr, sizeof(T));
+  return result;
+}
+
+struct ZipEntry {
+  uint64_t compressed_size = 0;
+  uint64_t local_header_offset = 0;
+  uint16_t method = 0;
+};
+}
+
+namespace archive {
+struct Reader::Impl {
+  std::vector<Entry> entries;
+  std::vector<ZipEntry> zip_entries;
+  std::filesystem::path directory;
+  uint8_t* data = nullptr;
+  size_t size = 0;
+
+  ~Impl() {
+    if (data) {
+      munmap(data, size);
+    }
+  }
+
+  bool map(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return false;
+    }
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      return false;
+    }
+    data = static_cast<uint8_t*>(addr);
+    size = st.st_size;
+    return true;
+  }
+
+  bool parse_central_directory() {
+    if (size < EOCD_SIZE) {
+      return false;
+    }
+
+    // the end of central directory record sits before an optional trailing comment
+    const size_t search_end = size - EOCD_SIZE;
+    const size_t search_begin = search_end > MAX_COMMENT_SIZE ? search_end - MAX_COMMENT_SIZE : 0;
+    size_t eocd = SIZE_MAX;
+    for (size_t pos = search_end + 1; pos-- > search_begin;) {
+      if (load<uint32_t>(data + pos) == EOCD_SIGNATURE) {
+        eocd = pos;
+        break;
+      }
+    }
+    if (eocd == SIZE_MAX) {
+      return false;
+    }
+
+    uint64_t entry_count = load<uint16_t>(data + eocd + 10);
+    uint64_t cd_size = load<uint32_t>(data + eocd + 12);
+    uint64_t cd_offset = load<uint32_t>(data + eocd + 16);
+
+    if (eocd >= ZIP64_EOCD_LOCATOR_SIZE &&
+        load<uint32_t>(data + eocd - ZIP64_EOCD_LOCATOR_SIZE) == ZIP64_EOCD_LOCATOR_SIGNATURE) {
+      const uint64_t zip64_eocd = load<uint64_t>(data + eocd - ZIP64_EOCD_LOCATOR_SIZE + 8);
+      if (zip64_eocd + ZIP64_EOCD_SIZE > size || load<uint32_t>(data + zip64_eocd) != ZIP64_EOCD_SIGNATURE) {
+        return false;
+      }
+      entry_count = load<uint64_t>(data + zip64_eocd + 32);
+      cd_size = load<uint64_t>(data + zip64_eocd + 40);
+      cd_offset = load<uint64_t>(data + zip64_eocd + 48);
+    }
+
+    if (cd_offset + cd_size > size) {
+      return false;
+    }
+
+    const uint8_t* addr = data + cd_offset;
+    const uint8_t* end = addr + cd_size;
+    entries.reserve(entry_count);
+    zip_entries.reserve(entry_count);
+    for (uint64_t i = 0; i < entry_count; i++) {
+      if (addr + CENTRAL_HEADER_SIZE > end || load<uint32_t>(addr) != CENTRAL_HEADER_SIGNATURE) {
+        return false;
+      }
+
+      const uint16_t method = load<uint16_t>(addr + 10);
+      uint64_t compressed_size = load<uint32_t>(addr + 20);
+      uint64_t uncompressed_size = load<uint32_t>(addr + 24);
+      const uint16_t name_len = load<uint16_t>(addr + 28);
+      const uint16_t extra_len = load<uint16_t>(addr + 30);
+      const uint16_t comment_len = load<uint16_t>(addr + 32);
+      uint64_t local_header_offset = load<uint32_t>(addr + 42);
+
+      const uint8_t* name_addr = addr + CENTRAL_HEADER_SIZE;
+      const uint8_t* extra_addr = name_addr + name_len;
+      const uint8_t* next = extra_addr + extra_len + comment_len;
+      if (next > end) {
+        return false;
+      }
+
+      // zip64 sizes and offsets are only present for fields that overflowed
+      const uint8_t* extra_end = extra_addr + extra_len;
+      while (extra_addr + 4 <= extra_end) {
+        const uint16_t id = load<uint16_t>(extra_addr);
+        const uint16_t len = load<uint16_t>(extra_addr + 2);
+        const uint8_t* field = extra_addr + 4;
+        const uint8_t* field_end = std::min(field + len, extra_end);
+        if (id == ZIP64_EXTRA_ID) {
+          for (uint64_t* value : {&uncompressed_size, &compressed_size, &local_header_offset}) {
+            if (*value == UINT32_MAX && field + sizeof(uint64_t) <= field_end) {
+              *value = load<uint64_t>(field);
+              field += sizeof(uint64_t);
+            }
+          }
+        }
+        extra_addr = field_end;
+      }
+
+      std::string name(reinterpret_cast<const char*>(name_addr), name_len);
+      if (!name.empty() && name.back() != '/') {
+        entries.push_back(Entry{.name = std::move(name), .size = uncompressed_size});
+        zip_entries.push_back(ZipEntry{
+            .compressed_size = compressed_size, .local_header_offset = local_header_offset, .method = method});
+      }
+      addr = next;
+    }
+
+    return true;
+  }
+
+  bool scan_directory(const std::string& path) {
+    directory = path;
+    std::error_code ec;
+    for (const auto& file : std::filesystem::recursive_directory_iterator(directory, ec)) {
+      if (!file.is_regular_file()) {
+        continue;
+      }
+      entries.push_back(Entry{.name = std::filesystem::relative(file.path(), directory).generic_string(),
+                              .size = file.file_size()});
+    }
+    return !ec;
+  }
+
+  bool read_zip(size_t index, std::string& out) const {
+    const auto& entry = zip_entries[index];
+    const uint64_t uncompressed_size = entries[index].size;
+    if (entry.local_header_offset + LOCAL_HEADER_SIZE > size ||
+        load<uint32_t>(data + entry.local_header_offset) != LOCAL_HEADER_SIGNATURE) {
+      return false;
+    }
+
+    // the local header can carry a different extra field than the central directory
+    const uint8_t* local = data + entry.local_header_offset;
+    const uint64_t data_offset =
+        entry.local_header_offset + LOCAL_HEADER_SIZE + load<uint16_t>(local + 26) + load<uint16_t>(local + 28);
+    if (data_offset + entry.compressed_size > size) {
+      return false;
+    }
+    const uint8_t* src = data + data_offset;
+
+    bool ok = false;
+    out.resize_and_overwrite(uncompressed_size, [&](char* buf, size_t n) -> size_t {
+      if (entry.method == METHOD_STORED) {
+        ok = entry.compressed_size == n;
+        if (ok) {
+          std::memcpy(buf, src, n);
+        }
+      } else if (entry.method == METHOD_DEFLATED) {
+        const size_t written = tinfl_decompress_mem_to_mem(buf, n, src, entry.compressed_size, 0);
+        ok = written == n;
+      }
+      return ok ? n : 0;
+    });
+    return ok;
+  }
+
+  bool read_file(size_t index, std::string& out) const {
+    std::ifstream file(directory / entries[index].name, std::ios::binary);
+    if (!file) {
+      return false;
+    }
+
+    const size_t file_size = entries[index].size;
+    out.resize_and_overwrite(file_size, [&](char* buf, size_t n) -> size_t {
+      file.read(buf, static_cast<std::streamsize>(n));
+      return static_cast<size_t>(file.gcount());
+    });
+    return out.size() == file_size;
+  }
+};
+
+Reader::Reader() : ptr_(std::make_unique<Impl>()) {}
+Reader::~Reader() = default;
+
+bool Reader::open(const std::string& path) {
+  ptr_ = std::make_unique<Impl>();
+  if (std::filesystem::is_directory(path)) {
+    return ptr_->scan_directory(path);
+  }
+  return ptr_->map(path) && ptr_->parse_central_directory();
+}
+
+const std::vector<Entry>& Reader::entries() const { return ptr_->entries; }
+
+bool Reader::read(size_t index, std::string& out) const {
+  if (index >= ptr_->entries.size()) {
+    return false;
+  }
+  return ptr_->data ? ptr_->read_zip(index, out) : ptr_->read_file(index, out);
+}
+
+bool Reader::read(std::string_view name, std::string& out) const {
+  const auto& entries = ptr_->entries;
+  auto it = std::ranges::find(entries, name, &Entry::name);
+  if (it == entries.end()) {
+    return false;
+  }
+  return read(static_cast<size_t>(it - entries.begin()), out);
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace archive {
+struct Entry {
+  std::string name;
+  uint64_t size = 0;
+};
+
+// read-only input for the importer, either a .zip file or an already extracted directory.
+// zip files are mapped and their central directory is parsed once, entries can be read from multiple threads.
+class Reader {
+ public:
+  Reader();
+  ~Reader();
+
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  bool open(const std::string& path);
+  const std::vector<Entry>& entries() const;
+
+  // inflates an entry into out, reusing its capacity
+  bool read(size_t index, std::string& out) const;
+  bool read(std::string_view name, std::string& out) const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> ptr_;
+};
+}
@@ -0,0 +1,257 @@
+#include "container.hpp"
+
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// header: magic, u32 version, u32 section count, u64 section table offset, u64 file size
+constexpr std::array<char, 8> MAGIC = {'H', 'O', 'S', 'H', 'I', 'D', 'C', 'T'};
+constexpr size_t HEADER_SIZE = 32;
+// sections start on page boundaries, so they can be advised and read ahead independently
+constexpr size_t ALIGNMENT = 4096;
+
+struct SectionEntry {
+  uint32_t id;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+};
+static_assert(sizeof(SectionEntry) == 24);
+
+template <typename T>
+T load(const uint8_t* addr) {
+  T result;
+  std::memcpy(&result, addr, sizeof(T));
+  return result;
+}
+
+template <typename T>
+void store(char* addr, T value) {
+  std::memcpy(addr, &value, sizeof(T));
+}
+}
+
+namespace container {
+struct Writer::Impl {
+  std::ofstream file;
+  std::vector<SectionEntry> sections;
+  bool in_section = false;
+
+  uint64_t position() { return static_cast<uint64_t>(file.tellp()); }
+
+  void align() {
+    static const std::array<char, ALIGNMENT> zeros{};
+    const uint64_t padding = (ALIGNMENT - position() % ALIGNMENT) % ALIGNMENT;
+    file.write(zeros.data(), static_cast<std::streamsize>(padding));
+  }
+};
+
+Writer::Writer(const std::string& path) : ptr_(std::make_unique<Impl>()) {
+  ptr_->file.exceptions(std::ios::failbit | std::ios::badbit);
+  ptr_->file.open(path, std::ios::binary | std::ios::trunc);
+  // placeholder until finish() knows the section table
+  const std::array<char, HEADER_SIZE> header{};
+  ptr_->file.write(header.data(), header.size());
+}
+
+Writer::~Writer() = default;
+
+void Writer::add(Section id, std::span<const char> data) {
+  begin(id).write(data.data(), static_cast<std::streamsize>(data.size()));
+  end();
+}
+
+void Writer::add(Section id, std::istream& data) {
+  std::ostream& out = begin(id);
+  std::array<char, 1 << 16> buf;
+  while (data.read(buf.data(), buf.size()) || data.gcount() > 0) {
+    out.write(buf.data(), data.gcount());
+  }
+  if (data.bad()) {
+    throw std::runtime_error("failed to read container section data");
+  }
+  end();
+}
+
+std::ostream& Writer::begin(Section id) {
+  if (ptr_->in_section) {
+    throw std::runtime_error("container section is still open");
+  }
+  ptr_->align();
+  ptr_->sections.push_back(
+      SectionEntry{.id = static_cast<uint32_t>(id), .reserved = 0, .offset = ptr_->position(), .size = 0});
+  ptr_->in_section = true;
+  return ptr_->file;
+}
+
+void Writer::end() {
+  auto& section = ptr_->sections.back();
+  section.size = ptr_->position() - section.offset;
+  ptr_->in_section = false;
+}
+
+void Writer::finish() {
+  if (ptr_->in_section) {
+    throw std::runtime_error("container section is still open");
+  }
+  auto& file = ptr_->file;
+  ptr_->align();
+  const uint64_t table_offset = ptr_->position();
+  file.write(reinterpret_cast<const char*>(ptr_->sections.data()),
+             static_cast<std::streamsize>(ptr_->sections.size() * sizeof(SectionEntry)));
+  const uint64_t file_size = ptr_->position();
+
+  std::array<char, HEADER_SIZE> header{};
+  std::ranges::copy(MAGIC, header.begin());
+  store<uint32_t>(header.data() + 8, VERSION);
+  store<uint32_t>(header.data() + 12, static_cast<uint32_t>(ptr_->sections.size()));
+  store<uint64_t>(header.data() + 16, table_offset);
+  store<uint64_t>(header.data() + 24, file_size);
+  file.seekp(0);
+  file.write(header.data(), header.size());
+  file.close();
+}
+
+struct Reader::Impl {
+  uint8_t* data = nullptr;
+  size_t size = 0;
+  std::vector<SectionEntry> sections;
+
+  ~Impl() {
+    if (data) {
+      munmap(data, size);
+    }
+  }
+
+  bool map(const std::string& path, bool populate) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HEADER_SIZE) {
+      close(fd);
+      return false;
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (populate) {
+      flags |= MAP_POPULATE;
+    }
+#endif
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      return false;
+    }
+    data = static_cast<uint8_t*>(addr);
+    size = st.st_size;
+#ifndef MAP_POPULATE
+    if (populate) {
+      madvise(data, size, MADV_WILLNEED);
+    }
+#endif
+    return true;
+  }
+
+  bool parse_header() {
+    if (!std::equal(MAGIC.begin(), MAGIC.end(), data) || load<uint32_t>(data + 8) != VERSION) {
+      return false;
+    }
+
+    const uint64_t section_count = load<uint32_t>(data + 12);
+    const uint64_t table_offset = load<uint64_t>(data + 16);
+    // a file size mismatch means the import was interrupted or the file was truncated
+    if (load<uint64_t>(data + 24) != size || table_offset > size ||
+        section_count > (size - table_offset) / sizeof(SectionEntry)) {
+      return false;
+    }
+
+    sections.resize(section_count);
+    // an empty table leaves sections without storage, which memcpy can't be given
+    if (section_count > 0) {
+      std::memcpy(sections.data(), data + table_offset, section_count * sizeof(SectionEntry));
+    }
+    return std::ranges::all_of(
+        sections, [&](const SectionEntry& s) { return s.offset <= size && s.size <= size - s.offset; });
+  }
+
+  // pages spanned by a section. sections are aligned to ALIGNMENT, which can be smaller than the system page size
+  std::span<uint8_t> pages(Section id) const {
+    auto it = std::ranges::find(sections, static_cast<uint32_t>(id), &SectionEntry::id);
+    if (it == sections.end() || it->size == 0) {
+      return {};
+    }
+    const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t begin = it->offset / page_size * page_size;
+    return {data + begin, it->offset + it->size - begin};
+  }
+};
+
+Reader::Reader() : ptr_(std::make_unique<Impl>()) {}
+Reader::~Reader() = default;
+
+bool Reader::open(const std::string& path, bool populate) {
+  ptr_ = std::make_unique<Impl>();
+  return ptr_->map(path, populate) && ptr_->parse_header();
+}
+
+bool Reader::has(Section id) const {
+  return std::ranges::find(ptr_->sections, static_cast<uint32_t>(id), &SectionEntry::id) != ptr_->sections.end();
+}
+
+std::span<const uint8_t> Reader::section(Section id) const {
+  auto it = std::ranges::find(ptr_->sections, static_cast<uint32_t>(id), &SectionEntry::id);
+  if (it == ptr_->sections.end()) {
+    return {};
+  }
+  return {ptr_->data + it->offset, it->size};
+}
+
+std::span<const uint8_t> Reader::data() const { return {ptr_->data, ptr_->size}; }
+
+bool Reader::advise(Section id, Advice advice) const {
+  const auto pages = ptr_->pages(id);
+  if (pages.empty()) {
+    return true;
+  }
+  switch (advice) {
+    case Advice::willneed:
+      return madvise(pages.data(), pages.size(), MADV_WILLNEED) == 0;
+    case Advice::hugepage:
+#ifdef MADV_HUGEPAGE
+      return madvise(pages.data(), pages.size(), MADV_HUGEPAGE) == 0;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+bool Reader::lock(Section id) const {
+  const auto pages = ptr_->pages(id);
+  return pages.empty() || mlock(pages.data(), pages.size()) == 0;
+}
+
+void Reader::touch(Section id) const {
+  const auto pages = ptr_->pages(id);
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  // volatile keeps the reads from being optimized away
+  uint8_t sum = 0;
+  for (size_t pos = 0; pos < pages.size(); pos += page_size) {
+    sum += static_cast<const volatile uint8_t*>(pages.data())[pos];
+  }
+  static_cast<void>(sum);
+}
+}
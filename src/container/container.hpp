@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+
+// single-file dictionary format: a fixed header, page aligned sections and a section table at the end.
+// the whole file is mapped once and sections are used in place.
+namespace container {
+constexpr std::string_view EXTENSION = ".hoshidict";
+constexpr uint32_t VERSION = 7;
+
+enum class Section : uint32_t {
+  title,
+  index,
+  styles,
+  glossary_dict,
+  tags,
+  blobs,
+  term_phf,
+  term_offsets,
+  meta_phf,
+  meta_offsets,
+  media,
+  media_phf,
+  media_index,
+  term_keys,
+  meta_keys,
+  term_sorted_keys,
+  term_suffixes,
+  glossary_tokens,
+};
+
+// kernel hints for the pages of a mapped section
+enum class Advice : uint8_t {
+  // read the section ahead in the background
+  willneed,
+  // back the section with transparent huge pages where the kernel supports it for file mappings
+  hugepage,
+};
+
+// sections are written one after another, throws std::runtime_error or std::ios::failure on errors
+class Writer {
+ public:
+  explicit Writer(const std::string& path);
+  ~Writer();
+
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  void add(Section id, std::span<const char> data);
+  // copies the rest of data into the section
+  void add(Section id, std::istream& data);
+  // everything written to the returned stream until end() belongs to the section
+  std::ostream& begin(Section id);
+  void end();
+  // writes the section table and the header
+  void finish();
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> ptr_;
+};
+
+class Reader {
+ public:
+  Reader();
+  ~Reader();
+
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  // populate reads the whole file in while mapping it
+  bool open(const std::string& path, bool populate = false);
+  bool has(Section id) const;
+  // empty span if the section doesn't exist
+  std::span<const uint8_t> section(Section id) const;
+  std::span<const uint8_t> data() const;
+
+  // residency controls work on the pages spanned by a section and return false if the kernel refused them.
+  // locked pages stay resident until the file is closed, up to RLIMIT_MEMLOCK
+  bool advise(Section id, Advice advice) const;
+  bool lock(Section id) const;
+  // faults in every page of a section by reading one byte per page
+  void touch(Section id) const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> ptr_;
+};
+}
@@ -1256,64 +1256,88 @@ void Deinflector::add_rule(const Rule& rule) {
   max_length_ = std::max<size_t>(utf8::distance(rule.from.begin(), rule.from.end()), max_length_);
 }
 
-std::vector<DeinflectionResult> Deinflector::deinflect(const std::string& text) const {
-  std::vector<DeinflectionResult> result{};
-  std::vector<TransformGroup> trace{};
+std::pmr::vector<DeinflectionResult> Deinflector::deinflect(std::string_view text,
+                                                            std::pmr::memory_resource* resource) const {
+  std::pmr::vector<DeinflectionResult> result(resource);
+  std::pmr::vector<const TransformGroup*> trace(resource);
   size_t text_len = utf8::distance(text.begin(), text.end());
   if (text_len > 1) {
     deinflect_recursive(text, NONE, trace, result);
   } else {
-    result.emplace_back(text, NONE, trace);
+    result.push_back(DeinflectionResult{.text = std::pmr::string(text, resource), .conditions = NONE, .trace = trace});
   }
 
   return result;
 }
 
+uint32_t Deinflector::pos_to_condition(std::string_view part_of_speech) {
+  if (part_of_speech == "v1") {
+    return V1;
+  } else if (part_of_speech == "v5") {
+    return V5;
+  } else if (part_of_speech == "vk") {
+    return VK;
+  } else if (part_of_speech == "vs") {
+    return VS;
+  } else if (part_of_speech == "vz") {
+    return VZ;
+  } else if (part_of_speech == "adj-i") {
+    return ADJ_I;
+  }
+  return NONE;
+}
+
 uint32_t Deinflector::pos_to_conditions(const std::vector<std::string>& part_of_speech) {
   uint32_t result = 0;
   for (const auto& p : part_of_speech) {
-    if (p == "v1") {
-      result |= V1;
-    } else if (p == "v5") {
-      result |= V5;
-    } else if (p == "vk") {
-      result |= VK;
-    } else if (p == "vs") {
-      result |= VS;
-    } else if (p == "vz") {
-      result |= VZ;
-    } else if (p == "adj-i") {
-      result |= ADJ_I;
-    }
+    result |= pos_to_condition(p);
+  }
+  return result;
+}
+
+uint32_t Deinflector::pos_to_conditions(std::string_view part_of_speech) {
+  constexpr std::string_view WHITESPACE = " \t\n\v\f\r";
+  uint32_t result = 0;
+  size_t pos = part_of_speech.find_first_not_of(WHITESPACE);
+  while (pos != std::string_view::npos) {
+    const size_t end = std::min(part_of_speech.find_first_of(WHITESPACE, pos), part_of_speech.size());
+    result |= pos_to_condition(part_of_speech.substr(pos, end - pos));
+    pos = part_of_speech.find_first_not_of(WHITESPACE, end);
   }
   return result;
 }
 
-void Deinflector::deinflect_recursive(const std::string& text, uint32_t conditions, std::vector<TransformGroup>& trace,
-                                      std::vector<DeinflectionResult>& results) const {
+void Deinflector::deinflect_recursive(std::string_view text, uint32_t conditions,
+                                      std::pmr::vector<const TransformGroup*>& trace,
+                                      std::pmr::vector<DeinflectionResult>& results) const {
   size_t text_len = utf8::distance(text.begin(), text.end());
   if (text_len <= 1) {
     return;
   }
-  results.emplace_back(text, conditions, trace);
+  auto* resource = results.get_allocator().resource();
+  results.push_back(DeinflectionResult{.text = std::pmr::string(text, resource),
+                                       .conditions = conditions,
+                                       .trace = std::pmr::vector<const TransformGroup*>(trace, resource)});
 
   size_t start = std::min(max_length_, text_len);
   auto prefix_it = text.begin();
   utf8::advance(prefix_it, text_len - start, text.end());
 
+  std::pmr::string transformed(resource);
   for (size_t i = start; i > 0; i--) {
-    std::string suffix(prefix_it, text.end());
+    std::string_view suffix(prefix_it, text.end());
     auto it = transforms_.find(suffix);
     if (it != transforms_.end()) {
-      std::string prefix(text.begin(), prefix_it);
+      std::string_view prefix(text.begin(), prefix_it);
       for (const auto& rule : it->second) {
         if (conditions != NONE && !(conditions & rule.conditions_in)) {
           continue;
         }
 
-        std::string transformed = prefix + rule.to;
+        transformed.assign(prefix);
+        transformed += rule.to;
 
-        trace.push_back(groups_[rule.group_id]);
+        trace.push_back(&groups_[rule.group_id]);
         deinflect_recursive(transformed, rule.conditions_out, trace, results);
         trace.pop_back();
       }
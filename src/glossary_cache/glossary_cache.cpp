@@ -0,0 +1,72 @@
+#include "glossary_cache.hpp"
+
+#include <algorithm>
+
+namespace {
+// list node and index slot on top of the string itself
+constexpr size_t ENTRY_OVERHEAD = 64;
+}
+
+GlossaryCache::GlossaryCache(size_t byte_budget, size_t num_shards) {
+  num_shards = std::max<size_t>(1, num_shards);
+  shard_budget_ = byte_budget / num_shards;
+  for (size_t i = 0; i < num_shards; i++) {
+    shards_.push_back(std::make_unique<Shard>());
+  }
+}
+
+GlossaryCache::Shard& GlossaryCache::shard(uint64_t key) {
+  // keys of one dictionary differ in their low bits only, mix them before picking a shard
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return *shards_[key % shards_.size()];
+}
+
+size_t GlossaryCache::entry_size(const std::string& value) { return value.size() + ENTRY_OVERHEAD; }
+
+bool GlossaryCache::get(uint64_t key, std::string& out) {
+  auto& s = shard(key);
+  std::scoped_lock lock(s.mutex);
+  auto it = s.index.find(key);
+  if (it == s.index.end()) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  s.entries.splice(s.entries.begin(), s.entries, it->second);
+  out = it->second->value;
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void GlossaryCache::put(uint64_t key, const std::string& value) {
+  const size_t size = entry_size(value);
+  if (size > shard_budget_) {
+    return;
+  }
+
+  auto& s = shard(key);
+  std::scoped_lock lock(s.mutex);
+  if (s.index.contains(key)) {
+    return;
+  }
+  while (!s.entries.empty() && s.size_bytes + size > shard_budget_) {
+    const auto& last = s.entries.back();
+    s.size_bytes -= entry_size(last.value);
+    s.index.erase(last.key);
+    s.entries.pop_back();
+  }
+  s.entries.push_front(Entry{.key = key, .value = value});
+  s.index.emplace(key, s.entries.begin());
+  s.size_bytes += size;
+}
+
+GlossaryCache::Stats GlossaryCache::stats() const {
+  Stats stats{.hits = hits_.load(), .misses = misses_.load(), .size_bytes = 0, .entries = 0};
+  for (const auto& s : shards_) {
+    std::scoped_lock lock(s->mutex);
+    stats.size_bytes += s->size_bytes;
+    stats.entries += s->entries.size();
+  }
+  return stats;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <ankerl/unordered_dense.h>
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// byte-bounded lru cache of decompressed glossaries. keys are spread over independently locked shards, so
+// concurrent lookups rarely wait on each other
+class GlossaryCache {
+ public:
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t size_bytes;
+    size_t entries;
+  };
+
+  explicit GlossaryCache(size_t byte_budget, size_t num_shards = 16);
+
+  GlossaryCache(const GlossaryCache&) = delete;
+  GlossaryCache& operator=(const GlossaryCache&) = delete;
+
+  // copies the cached value into out and marks it as recently used
+  bool get(uint64_t key, std::string& out);
+  void put(uint64_t key, const std::string& value);
+  Stats stats() const;
+
+ private:
+  struct Entry {
+    uint64_t key;
+    std::string value;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    // most recently used first
+    std::list<Entry> entries;
+    ankerl::unordered_dense::map<uint64_t, std::list<Entry>::iterator> index;
+    size_t size_bytes = 0;
+  };
+
+  Shard& shard(uint64_t key);
+  static size_t entry_size(const std::string& value);
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  size_t shard_budget_;
+  std::atomic<uint64_t> hits_ = 0;
+  std::atomic<uint64_t> misses_ = 0;
+};
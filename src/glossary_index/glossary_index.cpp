@@ -0,0 +1,152 @@
+#include "glossary_index.hpp"
+
+#include <algorithm>
+
+namespace {
+bool is_token_char(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'); }
+
+char to_lower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+
+class Tokenizer {
+ public:
+  explicit Tokenizer(std::vector<std::string>& tokens) : tokens_(tokens) {}
+
+  void add(char c) {
+    if (is_token_char(c)) {
+      current_ += to_lower(c);
+    } else {
+      flush();
+    }
+  }
+
+  void flush() {
+    if (!current_.empty()) {
+      tokens_.push_back(std::move(current_));
+      current_.clear();
+    }
+  }
+
+ private:
+  std::vector<std::string>& tokens_;
+  std::string current_;
+};
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// reads the json string starting after the opening quote, pos ends after the closing quote.
+// escapes are resolved only as far as tokens need them, non-ascii escapes become separators
+void read_string(std::string_view json, size_t& pos, Tokenizer* tokenizer) {
+  while (pos < json.size()) {
+    char c = json[pos++];
+    if (c == '"') {
+      break;
+    }
+    if (c == '\\' && pos < json.size()) {
+      c = json[pos++];
+      if (c == 'u') {
+        int value = 0;
+        for (int i = 0; i < 4 && pos < json.size(); i++) {
+          const int digit = hex_value(json[pos++]);
+          value = digit < 0 ? 0x80 : value * 16 + digit;
+        }
+        c = value < 0x80 ? static_cast<char>(value) : ' ';
+      } else if (c != '"' && c != '\\' && c != '/') {
+        c = ' ';
+      }
+    }
+    if (tokenizer) {
+      tokenizer->add(c);
+    }
+  }
+  if (tokenizer) {
+    tokenizer->flush();
+  }
+}
+
+// text lives in top level strings and in the values of content and text members
+bool is_text_key(std::string_view key) { return key.empty() || key == "content" || key == "text"; }
+}
+
+namespace glossary_index {
+std::vector<std::string> tokenize_glossary(std::string_view glossary_json) {
+  std::vector<std::string> tokens;
+  Tokenizer tokenizer(tokens);
+
+  struct Frame {
+    bool object;
+    // member key of the container, array elements inherit the key of their array
+    std::string_view key;
+    bool expect_key;
+    std::string_view member;
+  };
+  std::vector<Frame> frames;
+
+  auto value_key = [&]() -> std::string_view {
+    if (frames.empty()) {
+      return {};
+    }
+    return frames.back().object ? frames.back().member : frames.back().key;
+  };
+
+  size_t pos = 0;
+  while (pos < glossary_json.size()) {
+    const char c = glossary_json[pos++];
+    switch (c) {
+      case '"': {
+        const size_t start = pos;
+        if (!frames.empty() && frames.back().object && frames.back().expect_key) {
+          read_string(glossary_json, pos, nullptr);
+          frames.back().member = glossary_json.substr(start, pos - start - 1);
+          frames.back().expect_key = false;
+        } else {
+          read_string(glossary_json, pos, is_text_key(value_key()) ? &tokenizer : nullptr);
+        }
+        break;
+      }
+      case '{':
+      case '[':
+        frames.push_back(Frame{.object = c == '{', .key = value_key(), .expect_key = c == '{', .member = {}});
+        break;
+      case '}':
+      case ']':
+        if (!frames.empty()) {
+          frames.pop_back();
+        }
+        break;
+      case ',':
+        if (!frames.empty() && frames.back().object) {
+          frames.back().expect_key = true;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  std::ranges::sort(tokens);
+  const auto [first, last] = std::ranges::unique(tokens);
+  tokens.erase(first, last);
+  return tokens;
+}
+
+std::vector<std::string> tokenize(std::string_view text) {
+  std::vector<std::string> tokens;
+  Tokenizer tokenizer(tokens);
+  for (char c : text) {
+    tokenizer.add(c);
+  }
+  tokenizer.flush();
+  return tokens;
+}
+}
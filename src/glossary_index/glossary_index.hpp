@@ -0,0 +1,14 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+// tokenizer shared by the glossary index of the importer and glossary search.
+// tokens are lowercased runs of ascii letters and digits, other characters separate them.
+namespace glossary_index {
+// tokens of the text in a glossary json array, including text nested in structured content.
+// object keys and attribute values like tags, styles or links are skipped, every token is returned once
+std::vector<std::string> tokenize_glossary(std::string_view glossary_json);
+// tokens of plain text in the order they appear
+std::vector<std::string> tokenize(std::string_view text);
+}
@@ -1,58 +1,316 @@
 #include "hash.hpp"
 
-#include <pthash.hpp>
-#include <variant>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <stdexcept>
 
 namespace hash {
-struct xxhash64_sv {
-  using hash_type = pthash::hash64;
-  static pthash::hash64 hash(std::string_view s, uint64_t seed) {
-    return pthash::hash64{XXH64(s.data(), s.size(), seed)};
+namespace {
+// layout: u64 words for type, seed, key count, partition count, pilot count and free slot count, then the partition
+// table, the pilot table and the free slot table, each padded to 8 bytes
+constexpr size_t HEADER_WORDS = 6;
+// keys per partition, small enough that a partition's tables stay in cache while it is placed
+constexpr uint64_t PARTITION_SIZE = uint64_t{1} << 16;
+// keys per bucket and keys per table slot, larger buckets make smaller tables but longer pilot searches
+constexpr uint64_t BUCKET_SIZE = 4;
+constexpr uint64_t MAX_PILOT = uint64_t{1} << 20;
+constexpr uint64_t MAX_SEEDS = 64;
+
+using detail::fastrange;
+using detail::mix;
+using detail::position;
+
+size_t padded(size_t size) { return (size + 7) / 8 * 8; }
+
+size_t pilot_width(phf_type type) { return type == phf_type::pilots16 ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+// runs fn(i) for every i below count on up to threads threads, the calling thread included
+template <typename Fn>
+void parallel_for(size_t threads, size_t count, Fn&& fn) {
+  std::atomic<size_t> next = 0;
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      fn(i);
+    }
+  };
+  std::vector<std::future<void>> workers;
+  for (size_t t = 1; t < std::min(threads, count); t++) {
+    workers.push_back(std::async(std::launch::async, worker));
   }
-};
+  worker();
+  for (auto& w : workers) {
+    w.get();
+  }
+}
 
-using dense_phf = pthash::dense_partitioned_phf<xxhash64_sv, pthash::skew_bucketer, pthash::C_int, true>;
-using single_phf = pthash::single_phf<xxhash64_sv, pthash::skew_bucketer, pthash::compact, true>;
-struct mphf::phf {
-  phf_type type = phf_type::dense;
-  std::variant<dense_phf, single_phf> phf;
+struct Built {
+  uint64_t seed = 0;
+  uint64_t table_size = 0;
+  std::vector<uint32_t> pilots;
+  std::vector<uint32_t> free_slots;
 };
 
-mphf::mphf() : ptr_(std::make_unique<phf>()) {};
-mphf::~mphf() = default;
-uint64_t mphf::operator()(std::string_view key) const {
-  return std::visit([&](auto const& phf) { return phf(key); }, ptr_->phf);
+// places every bucket of a partition, largest first, at the first pilot whose slots are all free. hashes are sorted
+// by bucket, false if a bucket can't be placed under this seed
+bool place(std::span<const std::pair<uint64_t, uint64_t>> hashes, std::span<const uint64_t> bucket_begin,
+           std::span<const uint64_t> order, uint64_t seed, Built& built) {
+  const uint64_t key_count = hashes.size();
+  const uint64_t table_size = built.table_size;
+  std::ranges::fill(built.pilots, 0);
+
+  std::vector<uint64_t> taken((table_size + 63) / 64);
+  auto is_taken = [&](uint64_t p) { return (taken[p / 64] >> (p % 64)) & 1; };
+  std::vector<uint64_t> positions;
+  for (uint64_t b : order) {
+    const auto bucket = hashes.subspan(bucket_begin[b], bucket_begin[b + 1] - bucket_begin[b]);
+    if (bucket.empty()) {
+      break;
+    }
+    uint64_t pilot = 0;
+    for (;; pilot++) {
+      if (pilot == MAX_PILOT) {
+        return false;
+      }
+      positions.clear();
+      for (const auto& [bucket_id, key_hash] : bucket) {
+        const uint64_t p = position(key_hash, pilot, seed, table_size);
+        if (is_taken(p) || std::ranges::find(positions, p) != positions.end()) {
+          break;
+        }
+        positions.push_back(p);
+      }
+      if (positions.size() == bucket.size()) {
+        break;
+      }
+    }
+    for (uint64_t p : positions) {
+      taken[p / 64] |= uint64_t{1} << (p % 64);
+    }
+    built.pilots[b] = static_cast<uint32_t>(pilot);
+  }
+
+  // slots past the key count are remapped to the free slots below it, which makes the phf minimal
+  built.free_slots.assign(table_size - key_count, 0);
+  uint64_t next_free = 0;
+  for (uint64_t p = key_count; p < table_size; p++) {
+    if (is_taken(p)) {
+      while (is_taken(next_free)) {
+        next_free++;
+      }
+      built.free_slots[p - key_count] = static_cast<uint32_t>(next_free++);
+    }
+  }
+  built.seed = seed;
+  return true;
+}
+
+// tries seeds derived from partition_seed until one places every bucket. false if two key hashes are equal, which
+// no partition seed separates
+bool build_partition(std::span<const uint64_t> key_hashes, uint64_t partition_seed, Built& built) {
+  const uint64_t key_count = key_hashes.size();
+  const uint64_t bucket_count = std::max<uint64_t>(1, (key_count + BUCKET_SIZE - 1) / BUCKET_SIZE);
+  // about 3% spare slots keep the pilot search for the last buckets short
+  built.table_size = key_count + key_count / 32 + 1;
+  built.pilots.resize(bucket_count);
+
+  std::vector<std::pair<uint64_t, uint64_t>> hashes(key_count);
+  for (size_t i = 0; i < key_count; i++) {
+    hashes[i] = {fastrange(key_hashes[i], bucket_count), key_hashes[i]};
+  }
+  std::ranges::sort(hashes);
+  if (std::ranges::adjacent_find(hashes) != hashes.end()) {
+    return false;
+  }
+
+  std::vector<uint64_t> bucket_begin(bucket_count + 1);
+  for (const auto& [bucket, key_hash] : hashes) {
+    bucket_begin[bucket + 1]++;
+  }
+  for (uint64_t b = 0; b < bucket_count; b++) {
+    bucket_begin[b + 1] += bucket_begin[b];
+  }
+  std::vector<uint64_t> order(bucket_count);
+  for (uint64_t b = 0; b < bucket_count; b++) {
+    order[b] = b;
+  }
+  std::ranges::stable_sort(order, std::greater<>(), [&](uint64_t b) { return bucket_begin[b + 1] - bucket_begin[b]; });
+
+  for (uint64_t attempt = 0; attempt < MAX_SEEDS; attempt++) {
+    if (place(hashes, bucket_begin, order, mix(partition_seed + attempt), built)) {
+      return true;
+    }
+  }
+  throw std::runtime_error("failed to build the perfect hash function");
+}
+}
+
+void mphf::hash_many(std::span<const std::string_view> keys, std::span<uint64_t> slots) const {
+  visit([&](const auto& probe) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      slots[i] = probe.hash(keys[i]);
+      __builtin_prefetch(probe.pilot_addr(slots[i]));
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+      slots[i] = probe.slot(slots[i]);
+    }
+  });
 }
 
-void mphf::build(const std::vector<std::string_view>& keys) {
-  pthash::build_configuration config;
-  config.verbose = false;
-  config.num_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
-  if (keys.size() >= 4096) {
-    ptr_->type = phf_type::dense;
-    auto& phf = ptr_->phf.emplace<dense_phf>();
-    phf.build_in_internal_memory(keys.begin(), keys.size(), config);
-  } else {
-    ptr_->type = phf_type::single;
-    auto& phf = ptr_->phf.emplace<single_phf>();
-    phf.build_in_internal_memory(keys.begin(), keys.size(), config);
+void mphf::build(const std::vector<std::string_view>& keys, size_t threads) {
+  if (keys.size() > UINT32_MAX) {
+    throw std::runtime_error("too many keys for the perfect hash function");
+  }
+  const uint64_t key_count = keys.size();
+  const uint64_t partition_count = std::max<uint64_t>(1, (key_count + PARTITION_SIZE - 1) / PARTITION_SIZE);
+  std::vector<uint64_t> hashes(key_count);
+  std::vector<uint64_t> partition_hashes(key_count);
+  std::vector<uint64_t> partition_begin(partition_count + 1);
+  std::vector<Built> partitions(partition_count);
+  uint64_t seed = 0;
+  bool placed = false;
+  for (uint64_t attempt = 0; attempt < MAX_SEEDS && !placed; attempt++) {
+    seed = mix(attempt + 1);
+    parallel_for(threads, partition_count, [&](size_t chunk) {
+      const size_t end = std::min<size_t>(key_count, (chunk + 1) * PARTITION_SIZE);
+      for (size_t i = chunk * PARTITION_SIZE; i < end; i++) {
+        hashes[i] = XXH3_64bits_withSeed(keys[i].data(), keys[i].size(), seed);
+      }
+    });
+    // counting sort of the hashes by partition, in key order within a partition
+    std::ranges::fill(partition_begin, 0);
+    for (uint64_t key_hash : hashes) {
+      partition_begin[fastrange(mix(key_hash), partition_count) + 1]++;
+    }
+    for (uint64_t p = 0; p < partition_count; p++) {
+      partition_begin[p + 1] += partition_begin[p];
+    }
+    std::vector<uint64_t> next(partition_begin.begin(), partition_begin.end() - 1);
+    for (uint64_t key_hash : hashes) {
+      partition_hashes[next[fastrange(mix(key_hash), partition_count)]++] = key_hash;
+    }
+
+    std::vector<uint8_t> partition_placed(partition_count);
+    parallel_for(threads, partition_count, [&](size_t p) {
+      const auto partition_keys =
+          std::span(partition_hashes).subspan(partition_begin[p], partition_begin[p + 1] - partition_begin[p]);
+      partition_placed[p] = build_partition(partition_keys, mix(seed ^ (p * MAX_SEEDS)), partitions[p]);
+    });
+    placed = std::ranges::all_of(partition_placed, [](uint8_t ok) { return ok != 0; });
+  }
+  if (!placed) {
+    throw std::runtime_error("failed to build the perfect hash function");
+  }
+
+  uint32_t max_pilot = 0;
+  uint64_t pilot_count = 0;
+  uint64_t free_count = 0;
+  for (const Built& built : partitions) {
+    max_pilot = std::max(max_pilot, std::ranges::max(built.pilots));
+    pilot_count += built.pilots.size();
+    free_count += built.free_slots.size();
   }
+  const phf_type type = max_pilot <= UINT16_MAX ? phf_type::pilots16 : phf_type::pilots32;
+  const size_t partitions_size = partition_count * sizeof(phf_partition);
+  const size_t pilots_size = padded(pilot_count * pilot_width(type));
+  const size_t free_slots_size = padded(free_count * sizeof(uint32_t));
+  auto& storage = storage_;
+  storage.assign(HEADER_WORDS + (partitions_size + pilots_size + free_slots_size) / sizeof(uint64_t), 0);
+  storage[0] = type;
+  storage[1] = seed;
+  storage[2] = key_count;
+  storage[3] = partition_count;
+  storage[4] = pilot_count;
+  storage[5] = free_count;
+  auto* descriptors = reinterpret_cast<phf_partition*>(storage.data() + HEADER_WORDS);
+  auto* pilots = reinterpret_cast<uint8_t*>(descriptors + partition_count);
+  auto* free_slots = pilots + pilots_size;
+  uint64_t pilot_begin = 0;
+  uint64_t free_begin = 0;
+  for (uint64_t p = 0; p < partition_count; p++) {
+    const Built& built = partitions[p];
+    descriptors[p] = {.base = partition_begin[p],
+                      .key_count = partition_begin[p + 1] - partition_begin[p],
+                      .table_size = built.table_size,
+                      .bucket_count = built.pilots.size(),
+                      .seed = built.seed,
+                      .pilot_begin = pilot_begin,
+                      .free_begin = free_begin,
+                      .reserved = 0};
+    for (uint32_t pilot : built.pilots) {
+      if (type == phf_type::pilots16) {
+        const auto pilot16 = static_cast<uint16_t>(pilot);
+        std::memcpy(pilots + pilot_begin * sizeof(pilot16), &pilot16, sizeof(pilot16));
+      } else {
+        std::memcpy(pilots + pilot_begin * sizeof(pilot), &pilot, sizeof(pilot));
+      }
+      pilot_begin++;
+    }
+    std::memcpy(free_slots + free_begin * sizeof(uint32_t), built.free_slots.data(),
+                built.free_slots.size() * sizeof(uint32_t));
+    free_begin += built.free_slots.size();
+  }
+
+  const auto* bytes = reinterpret_cast<const uint8_t*>(storage.data());
+  load({bytes, storage.size() * sizeof(uint64_t)});
 }
 
-void mphf::save(const std::string& path) {
-  std::visit([&](auto const& phf) { essentials::save(phf, path.c_str()); }, ptr_->phf);
+void mphf::save(std::vector<char>& out) {
+  const auto* bytes = reinterpret_cast<const char*>(storage_.data());
+  out.insert(out.end(), bytes, bytes + storage_.size() * sizeof(uint64_t));
 }
 
-void mphf::load(const std::string& path, phf_type type) {
-  ptr_->type = type;
-  if (type == phf_type::dense) {
-    auto& phf = ptr_->phf.emplace<dense_phf>();
-    essentials::load(phf, path.c_str());
-  } else {
-    auto& phf = ptr_->phf.emplace<single_phf>();
-    essentials::load(phf, path.c_str());
+bool mphf::load(std::span<const uint8_t> data) {
+  constexpr size_t HEADER_SIZE = HEADER_WORDS * sizeof(uint64_t);
+  if (data.size() < HEADER_SIZE || reinterpret_cast<uintptr_t>(data.data()) % alignof(uint64_t) != 0) {
+    return false;
+  }
+  const auto* header = reinterpret_cast<const uint64_t*>(data.data());
+  if (header[0] != phf_type::pilots16 && header[0] != phf_type::pilots32) {
+    return false;
+  }
+  const auto type = static_cast<phf_type>(header[0]);
+  const uint64_t key_count = header[2];
+  const uint64_t partition_count = header[3];
+  const uint64_t pilot_count = header[4];
+  const uint64_t free_count = header[5];
+  // sizes are checked one by one, so corrupt counts can't overflow the total
+  uint64_t available = data.size() - HEADER_SIZE;
+  if (partition_count == 0 || partition_count > available / sizeof(phf_partition)) {
+    return false;
+  }
+  available -= partition_count * sizeof(phf_partition);
+  if (pilot_count > available / pilot_width(type) || padded(pilot_count * pilot_width(type)) > available) {
+    return false;
+  }
+  const size_t pilots_size = padded(pilot_count * pilot_width(type));
+  if (free_count > (available - pilots_size) / sizeof(uint32_t)) {
+    return false;
+  }
+
+  // every probe stays inside the tables, slots past the key count are left to the caller's bounds check
+  const auto* partitions = reinterpret_cast<const phf_partition*>(header + HEADER_WORDS);
+  for (uint64_t p = 0; p < partition_count; p++) {
+    const phf_partition& part = partitions[p];
+    const bool keys_valid = part.base <= key_count && part.key_count <= key_count - part.base;
+    const bool pilots_valid = part.bucket_count > 0 && part.pilot_begin <= pilot_count &&
+                              part.bucket_count <= pilot_count - part.pilot_begin;
+    const bool free_slots_valid = part.table_size > part.key_count && part.free_begin <= free_count &&
+                                  part.table_size - part.key_count <= free_count - part.free_begin;
+    if (!keys_valid || !pilots_valid || !free_slots_valid) {
+      return false;
+    }
   }
+
+  type_ = type;
+  seed_ = header[1];
+  partition_count_ = partition_count;
+  partitions_ = partitions;
+  pilots_ = reinterpret_cast<const uint8_t*>(partitions + partition_count);
+  free_slots_ = reinterpret_cast<const uint32_t*>(pilots_ + pilots_size);
+  return true;
 }
 
-phf_type mphf::type() const { return ptr_->type; }
-}
\ No newline at end of file
+uint64_t slot_fingerprint(std::string_view key) { return XXH3_64bits(key.data(), key.size()) & ~SLOT_OFFSET_MASK; }
+}
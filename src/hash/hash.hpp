@@ -1,26 +1,158 @@
 #pragma once
+#include <xxh3.h>
+
 #include <cstdint>
-#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace hash {
+// key index slots pack a 40 bit posting list offset with a 24 bit key fingerprint
+constexpr int SLOT_OFFSET_BITS = 40;
+constexpr uint64_t SLOT_OFFSET_MASK = (uint64_t{1} << SLOT_OFFSET_BITS) - 1;
+
+// fingerprint in the upper bits of a slot, independent of the phf hash. the phf maps keys outside its key set to
+// arbitrary slots, a mismatching fingerprint rejects them without reading the posting list
+uint64_t slot_fingerprint(std::string_view key);
+
+// width of the pilot table, the only part of the layout that differs between phfs
 enum phf_type : std::uint8_t {
-  dense,
-  single
+  pilots16,
+  pilots32
+};
+
+namespace detail {
+// splitmix64 finalizer, a bijection, so distinct key hashes never collide before the range reduction
+inline uint64_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111eb;
+  x ^= x >> 31;
+  return x;
+}
+
+inline uint64_t fastrange(uint64_t x, uint64_t n) {
+  return static_cast<uint64_t>((static_cast<unsigned __int128>(x) * n) >> 64);
+}
+
+inline uint64_t position(uint64_t key_hash, uint64_t pilot, uint64_t seed, uint64_t table_size) {
+  return fastrange(mix(key_hash ^ mix(pilot ^ seed)), table_size);
+}
+}
+
+// keys are split into partitions that are placed independently, so builds run in parallel. entries are u64 words
+// of the serialized form, slots of a partition start at base
+struct phf_partition {
+  uint64_t base;
+  uint64_t key_count;
+  uint64_t table_size;
+  uint64_t bucket_count;
+  uint64_t seed;
+  // first pilot and first free slot of the partition in the shared tables
+  uint64_t pilot_begin;
+  uint64_t free_begin;
+  uint64_t reserved;
+};
+
+// probe path for one pilot width. mphf::visit picks it once, so loops over keys run without branching on the layout
+template <typename Pilot>
+struct phf_probe {
+  uint64_t seed;
+  uint64_t partition_count;
+  const phf_partition* partitions;
+  const Pilot* pilots;
+  const uint32_t* free_slots;
+
+  uint64_t hash(std::string_view key) const { return XXH3_64bits_withSeed(key.data(), key.size(), seed); }
+  const phf_partition& partition(uint64_t key_hash) const {
+    return partitions[detail::fastrange(detail::mix(key_hash), partition_count)];
+  }
+  const Pilot* pilot_addr(uint64_t key_hash) const {
+    const phf_partition& part = partition(key_hash);
+    return pilots + part.pilot_begin + detail::fastrange(key_hash, part.bucket_count);
+  }
+
+  uint64_t slot(uint64_t key_hash) const {
+    const phf_partition& part = partition(key_hash);
+    const Pilot pilot = pilots[part.pilot_begin + detail::fastrange(key_hash, part.bucket_count)];
+    const uint64_t p = detail::position(key_hash, pilot, part.seed, part.table_size);
+    return part.base + (p < part.key_count ? p : free_slots[part.free_begin + p - part.key_count]);
+  }
+
+  uint64_t operator()(std::string_view key) const { return slot(hash(key)); }
 };
+
+class mphf;
+
+// single key probe of a phf with the pilot width resolved, see mphf::lookup
+using phf_lookup = uint64_t (*)(const mphf& phf, std::string_view key);
+
+// minimal perfect hash in the partitioned pthash scheme: keys are hashed into partitions and buckets, and every
+// bucket stores the pilot that places its keys into free slots of its partition. the serialized form is used in
+// place, so loading only validates the header and partition table and the pages stay shared with the page cache
 class mphf {
  public:
-  mphf();
-  ~mphf();
-  uint64_t operator()(std::string_view key) const;
-
-  void build(const std::vector<std::string_view>& keys);
-  void save(const std::string& path);
-  void load(const std::string& path, phf_type type);
-  phf_type type() const;
+  mphf() = default;
+  // loaded probes point into storage_, a copy would keep pointing into the original's
+  mphf(const mphf&) = delete;
+  mphf& operator=(const mphf&) = delete;
+  // moving the vector keeps its buffer, so the pointers stay valid
+  mphf(mphf&&) = default;
+  mphf& operator=(mphf&&) = default;
+
+  // calls fn with the phf_probe of the pilot width
+  template <typename Fn>
+  decltype(auto) visit(Fn&& fn) const {
+    if (type_ == phf_type::pilots16) {
+      return fn(probe<uint16_t>());
+    }
+    return fn(probe<uint32_t>());
+  }
+  uint64_t operator()(std::string_view key) const {
+    return visit([&](const auto& probe) { return probe(key); });
+  }
+  // probe for the loaded pilot width, callers probing single keys in a loop store it instead of calling operator()
+  phf_lookup lookup() const {
+    if (type_ == phf_type::pilots16) {
+      return &probe_key<uint16_t>;
+    }
+    return &probe_key<uint32_t>;
+  }
+  // slots of keys, every key is hashed and its pilot prefetched before any pilot is read
+  void hash_many(std::span<const std::string_view> keys, std::span<uint64_t> slots) const;
+
+  // keys have to be distinct, throws std::runtime_error if no phf is found. partitions are placed on up to threads
+  // threads, the result doesn't depend on the thread count
+  void build(const std::vector<std::string_view>& keys, size_t threads = 1);
+  // serialized form starts with the phf type, so load doesn't need it passed separately
+  void save(std::vector<char>& out);
+  // data has to be 8 byte aligned and outlive the phf, container sections are
+  bool load(std::span<const uint8_t> data);
+  phf_type type() const { return type_; }
+
  private:
-  struct phf;
-  std::unique_ptr<phf> ptr_;
+  template <typename Pilot>
+  phf_probe<Pilot> probe() const {
+    return {.seed = seed_,
+            .partition_count = partition_count_,
+            .partitions = partitions_,
+            .pilots = reinterpret_cast<const Pilot*>(pilots_),
+            .free_slots = free_slots_};
+  }
+  template <typename Pilot>
+  static uint64_t probe_key(const mphf& phf, std::string_view key) {
+    return phf.probe<Pilot>()(key);
+  }
+
+  // serialized form of a built phf, loaded phfs point into the mapped file instead
+  std::vector<uint64_t> storage_;
+  phf_type type_ = phf_type::pilots16;
+  uint64_t seed_ = 0;
+  uint64_t partition_count_ = 0;
+  const phf_partition* partitions_ = nullptr;
+  const uint8_t* pilots_ = nullptr;
+  const uint32_t* free_slots_ = nullptr;
 };
-}
\ No newline at end of file
+}
@@ -2,10 +2,11 @@
 
 #include <ankerl/unordered_dense.h>
 #include <xxh3.h>
-#include <zip.h>
+#include <zdict.h>
 #include <zstd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -13,133 +14,121 @@
 #include <filesystem>
 #include <fstream>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <ranges>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <thread>
 #include <vector>
 
+#include "archive/archive.hpp"
+#include "container/container.hpp"
+#include "glossary_index/glossary_index.hpp"
 #include "hash/hash.hpp"
+#include "postings/postings.hpp"
+#include "sorted_keys/sorted_keys.hpp"
+#include "thread_pool/thread_pool.hpp"
 #include "json/yomitan_parser.hpp"
 
 namespace {
-struct Files {
-  std::vector<int> term_banks;
-  std::vector<int> meta_banks;
-  std::vector<int> tag_banks;
-  std::vector<int> media_files;
-};
+// zstd recommends ~100x the dictionary size worth of samples
+constexpr size_t GLOSSARY_DICT_CAPACITY = 112 * 1024;
+constexpr size_t GLOSSARY_SAMPLE_BUDGET = 100 * GLOSSARY_DICT_CAPACITY;
+constexpr size_t GLOSSARY_SAMPLE_BANKS = 8;
+constexpr size_t GLOSSARY_MIN_SAMPLES = 1000;
 
-struct ProcessedFile {
-  std::vector<char> data;
-  ankerl::unordered_dense::map<std::string, std::vector<uint64_t>> term_offsets;
-  ankerl::unordered_dense::map<uint64_t, std::vector<char>> glossaries;
-  std::vector<std::pair<size_t, uint64_t>> glossary_offsets;
-  size_t count = 0;
+constexpr size_t WRITE_BUFFER_SIZE = 1 << 20;
+constexpr size_t COMPRESS_CHUNK_SIZE = 2048;
+constexpr size_t LOW_RAM_INDEX_BUDGET = 64 << 20;
+// larger buffers, usually from big media files, are freed instead of being kept for later banks
+constexpr size_t MAX_POOLED_BUFFER = 64 << 20;
+
+using CDictPtr = std::unique_ptr<ZSTD_CDict, decltype(&ZSTD_freeCDict)>;
+
+struct Files {
+  std::vector<size_t> term_banks;
+  std::vector<size_t> meta_banks;
+  std::vector<size_t> tag_banks;
+  std::vector<size_t> media_files;
 };
 
 struct MediaFile {
-  std::string path;
-  std::vector<char> blob;
+  size_t index;
+  std::string blob;
+  bool read;
 };
 
-void setup_stream_exceptions(std::ofstream& stream) { stream.exceptions(std::ios::failbit | std::ios::badbit); }
-
-std::string read_file_by_index(zip_t* archive, int index) {
-  if (zip_entry_openbyindex(archive, index) != 0) {
-    return "";
-  }
-
-  const size_t size = zip_entry_size(archive);
-  std::string buffer;
-  buffer.resize(size);
-  ssize_t bytes_read = 0;
-  if (size > 0) {
-    bytes_read = zip_entry_noallocread(archive, buffer.data(), size);
-  }
-  zip_entry_close(archive);
-
-  if (bytes_read < 0) {
-    return "";
-  }
-
-  return buffer;
-}
-
-std::string read_file_by_name(zip_t* archive, const char* name) {
-  if (zip_entry_open(archive, name) != 0) {
-    return "";
-  }
-
-  const size_t size = zip_entry_size(archive);
-  std::string buffer;
-  buffer.resize(size);
-  ssize_t bytes_read = 0;
-  if (size > 0) {
-    bytes_read = zip_entry_noallocread(archive, buffer.data(), size);
+// recycles inflate buffers between banks and files, so their capacity is reused across the import.
+// every archive read of the import goes through the pool
+class BufferPool {
+ public:
+  std::string acquire() {
+    std::scoped_lock lock(mutex_);
+    if (buffers_.empty()) {
+      return {};
+    }
+    std::string buffer = std::move(buffers_.back());
+    buffers_.pop_back();
+    return buffer;
   }
-  zip_entry_close(archive);
 
-  if (bytes_read < 0) {
-    return "";
+  void release(std::string&& buffer) {
+    if (buffer.capacity() > MAX_POOLED_BUFFER) {
+      return;
+    }
+    std::scoped_lock lock(mutex_);
+    buffers_.push_back(std::move(buffer));
   }
 
-  return buffer;
-}
-
-std::optional<MediaFile> read_media_by_index(zip_t* archive, int index) {
-  if (zip_entry_openbyindex(archive, index) != 0) {
-    return std::nullopt;
-  }
+ private:
+  std::mutex mutex_;
+  std::vector<std::string> buffers_;
+};
 
-  MediaFile out;
-  const size_t size = zip_entry_size(archive);
-  out.path = zip_entry_name(archive);
-  out.blob.resize(size);
-  ssize_t bytes_read = 0;
-  if (size > 0) {
-    bytes_read = zip_entry_noallocread(archive, out.blob.data(), size);
-  }
-  zip_entry_close(archive);
+struct Pipeline {
+  const archive::Reader& reader;
+  thread_pool::Pool& pool;
+  BufferPool& buffers;
+  // number of files processed ahead of the writer
+  size_t window;
+};
 
-  if (bytes_read < 0) {
-    return std::nullopt;
-  }
+struct ProcessedFile {
+  std::vector<char> data;
+  std::vector<std::pair<std::string, uint64_t>> keys;
+  // glossary tokens and the records they appear in, only filled for the glossary index
+  std::vector<std::pair<std::string, uint64_t>> tokens;
+  ankerl::unordered_dense::map<uint64_t, std::vector<char>> glossaries;
+  std::vector<std::pair<size_t, uint64_t>> glossary_offsets;
+  // tags missing from the tag banks, and the record positions of their placeholder ids
+  std::vector<std::string> missing_tags;
+  std::vector<std::pair<size_t, uint32_t>> tag_patches;
+  size_t count = 0;
+};
 
-  return out;
+std::filesystem::path dict_file_path(const std::string& output_dir, const std::string& title) {
+  return std::filesystem::path(output_dir) / (title + std::string(container::EXTENSION));
 }
 
-Files get_files(zip_t* archive) {
+Files get_files(const archive::Reader& reader) {
   Files files;
-  const ssize_t num_entries = zip_entries_total(archive);
-  if (num_entries < 0) {
-    return files;
-  }
-
-  for (int i = 0; i < num_entries; ++i) {
-    if (zip_entry_openbyindex(archive, i) != 0) {
-      continue;
+  const auto& entries = reader.entries();
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const std::string_view name = entries[i].name;
+    if (name.starts_with("term_bank_")) {
+      files.term_banks.push_back(i);
+    } else if (name.starts_with("term_meta_bank_")) {
+      files.meta_banks.push_back(i);
+    } else if (name.starts_with("tag_bank_")) {
+      files.tag_banks.push_back(i);
+    } else if (!(name == "styles.css" || name == "index.json")) {
+      files.media_files.push_back(i);
     }
-
-    if (zip_entry_isdir(archive) == 1) {
-      zip_entry_close(archive);
-      continue;
-    }
-
-    const char* raw_name = zip_entry_name(archive);
-    if (raw_name != nullptr) {
-      const std::string_view name(raw_name);
-      if (name.starts_with("term_bank_")) {
-        files.term_banks.push_back(i);
-      } else if (name.starts_with("term_meta_bank_")) {
-        files.meta_banks.push_back(i);
-      } else if (name.starts_with("tag_bank_")) {
-        files.tag_banks.push_back(i);
-      } else if (!(name == "styles.css" || name == "index.json")) {
-        files.media_files.push_back(i);
-      }
-    }
-    zip_entry_close(archive);
   }
 
   return files;
@@ -165,6 +154,15 @@ void write_u64(std::vector<char>& out, uint64_t value) {
   std::memcpy(out.data() + old_size, &value, sizeof(uint64_t));
 }
 
+// little endian base 128, 7 bits per byte with the high bit set on all but the last byte
+void write_varint(std::vector<char>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
 void write_str(std::vector<char>& out, std::string_view value) {
   if (value.empty()) {
     return;
@@ -180,24 +178,281 @@ void write_bytes(std::vector<char>& out, const void* data, size_t n) {
   std::memcpy(out.data() + old_size, data, n);
 }
 
-void merge_offsets(ankerl::unordered_dense::map<std::string, std::vector<uint64_t>>& a,
-                   ankerl::unordered_dense::map<std::string, std::vector<uint64_t>>& b, uint64_t write_offset) {
-  for (auto& [key, b_offsets] : b) {
-    for (auto& offset : b_offsets) {
-      offset += write_offset;
+// tags referenced by records are interned into small ids, tags missing from the tag banks get an empty entry
+// and are interned by the ordered writers, so their ids follow the bank order
+class TagTable {
+ public:
+  void add(const Tag& tag) {
+    std::scoped_lock lock(mutex_);
+    if (ids_.contains(std::string(tag.name))) {
+      return;
     }
+    insert(tag);
+  }
 
-    auto it = a.find(key);
-    if (it == a.end()) {
-      a.emplace(key, std::move(b_offsets));
-    } else {
-      auto& values = it->second;
-      values.insert(values.end(), b_offsets.begin(), b_offsets.end());
+  uint16_t intern(std::string_view name) {
+    std::scoped_lock lock(mutex_);
+    auto it = ids_.find(std::string(name));
+    if (it != ids_.end()) {
+      return it->second;
     }
+    return insert(Tag{.name = name, .category = "", .order = 0, .notes = "", .score = 0});
   }
+
+  std::optional<uint16_t> find(std::string_view name) const {
+    std::scoped_lock lock(mutex_);
+    auto it = ids_.find(std::string(name));
+    if (it == ids_.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  size_t size() const {
+    std::scoped_lock lock(mutex_);
+    return tags_.size();
+  }
+
+  void write(std::vector<char>& out) const {
+    std::scoped_lock lock(mutex_);
+    write_u32(out, tags_.size());
+    for (const auto& tag : tags_) {
+      write_u8(out, tag.name.size());
+      write_str(out, tag.name);
+      write_u8(out, tag.category.size());
+      write_str(out, tag.category);
+      write_u32(out, static_cast<uint32_t>(tag.order));
+      write_u16(out, tag.notes.size());
+      write_str(out, tag.notes);
+      write_u32(out, static_cast<uint32_t>(tag.score));
+    }
+  }
+
+ private:
+  struct Record {
+    std::string name;
+    std::string category;
+    int order;
+    std::string notes;
+    int score;
+  };
+
+  uint16_t insert(const Tag& tag) {
+    if (tags_.size() > UINT16_MAX) {
+      throw std::runtime_error("too many tags");
+    }
+    auto id = static_cast<uint16_t>(tags_.size());
+    tags_.push_back(Record{.name = std::string(tag.name.substr(0, UINT8_MAX)),
+                           .category = std::string(tag.category.substr(0, UINT8_MAX)),
+                           .order = tag.order,
+                           .notes = std::string(tag.notes.substr(0, UINT16_MAX)),
+                           .score = tag.score});
+    ids_.emplace(tag.name, id);
+    return id;
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<Record> tags_;
+  ankerl::unordered_dense::map<std::string, uint16_t> ids_;
+};
+
+constexpr uint32_t MISSING_TAG = 1u << 31;
+
+// tag ids of one bank, names missing from the table are numbered in first seen order and written as placeholders
+class BankTags {
+ public:
+  explicit BankTags(const TagTable& table) : table_(table) {}
+
+  // a table id, or MISSING_TAG with the index of the missing name
+  uint32_t resolve(std::string_view name) {
+    if (auto id = table_.find(name)) {
+      return *id;
+    }
+    auto [it, inserted] = missing_ids_.try_emplace(std::string(name), static_cast<uint32_t>(missing_.size()));
+    if (inserted) {
+      missing_.emplace_back(name);
+    }
+    return MISSING_TAG | it->second;
+  }
+
+  void write(std::vector<char>& out, std::span<const uint32_t> ids) {
+    const size_t count = std::min<size_t>(ids.size(), UINT8_MAX);
+    write_u8(out, count);
+    for (uint32_t id : ids.first(count)) {
+      if (id & MISSING_TAG) {
+        patches_.emplace_back(out.size(), id & ~MISSING_TAG);
+        id = 0;
+      }
+      write_u16(out, id);
+    }
+  }
+
+  void finish(ProcessedFile& processed) {
+    processed.missing_tags = std::move(missing_);
+    processed.tag_patches = std::move(patches_);
+  }
+
+ private:
+  const TagTable& table_;
+  std::vector<std::string> missing_;
+  ankerl::unordered_dense::map<std::string, uint32_t> missing_ids_;
+  std::vector<std::pair<size_t, uint32_t>> patches_;
+};
+
+// per bank cache in front of the bank tags, keys point into the bank content
+using TagCache = ankerl::unordered_dense::map<std::string_view, uint32_t>;
+
+// tag lists are separated by any ascii whitespace, like part of speech lists in the deinflector
+void write_tag_ids(std::vector<char>& out, std::string_view tags, BankTags& bank, TagCache& cache) {
+  constexpr std::string_view WHITESPACE = " \t\n\v\f\r";
+  std::vector<uint32_t> ids;
+  size_t pos = tags.find_first_not_of(WHITESPACE);
+  while (pos != std::string_view::npos) {
+    const size_t end = std::min(tags.find_first_of(WHITESPACE, pos), tags.size());
+    const std::string_view name = tags.substr(pos, end - pos);
+    pos = tags.find_first_not_of(WHITESPACE, end);
+    auto [it, inserted] = cache.try_emplace(name, 0);
+    if (inserted) {
+      it->second = bank.resolve(name);
+    }
+    ids.push_back(it->second);
+  }
+  bank.write(out, ids);
+}
+
+// runs in the ordered writer, interning the missing names of each bank in turn keeps their ids reproducible
+void resolve_missing_tags(ProcessedFile& processed, TagTable& tags) {
+  std::vector<uint16_t> ids;
+  ids.reserve(processed.missing_tags.size());
+  for (const auto& name : processed.missing_tags) {
+    ids.push_back(tags.intern(name));
+  }
+  for (auto [pos, index] : processed.tag_patches) {
+    std::memcpy(processed.data.data() + pos, &ids[index], sizeof(uint16_t));
+  }
+}
+
+void read_tag_banks(const archive::Reader& reader, BufferPool& buffers, const std::vector<size_t>& files,
+                    TagTable& table) {
+  std::string content = buffers.acquire();
+  for (size_t file_index : files) {
+    std::vector<Tag> tags;
+    if (!reader.read(file_index, content) || !yomitan_parser::parse_tag_bank(content, tags)) {
+      continue;
+    }
+    for (const auto& tag : tags) {
+      table.add(tag);
+    }
+  }
+  buffers.release(std::move(content));
 }
 
-ProcessedFile process_term_bank(const std::string& content) {
+// records and key indexes store u16 key lengths, entries with longer expressions or readings are skipped
+bool fits_key(std::string_view key) { return key.size() <= postings::MAX_KEY_SIZE; }
+
+void add_keys(postings::Builder& index, const ProcessedFile& processed, uint64_t write_offset) {
+  for (const auto& [key, offset] : processed.keys) {
+    index.add(key, offset + write_offset);
+  }
+}
+
+// samples glossaries from banks spread across the dictionary and trains a shared zstd dictionary,
+// returns an empty buffer if there is not enough data to train on
+std::vector<char> train_glossary_dict(const archive::Reader& reader, BufferPool& buffers,
+                                      const std::vector<size_t>& term_banks) {
+  std::vector<char> samples;
+  std::vector<size_t> sample_sizes;
+  ankerl::unordered_dense::set<uint64_t> seen;
+
+  std::string content = buffers.acquire();
+  const size_t stride = std::max<size_t>(1, term_banks.size() / GLOSSARY_SAMPLE_BANKS);
+  for (size_t i = 0; i < term_banks.size() && samples.size() < GLOSSARY_SAMPLE_BUDGET; i += stride) {
+    std::vector<Term> terms;
+    if (!reader.read(term_banks[i], content) || !yomitan_parser::parse_term_bank(content, terms)) {
+      continue;
+    }
+
+    for (const auto& term : terms) {
+      const std::string_view glossary = term.glossary.str;
+      if (glossary.empty() || !seen.insert(XXH3_64bits(glossary.data(), glossary.size())).second) {
+        continue;
+      }
+      write_str(samples, glossary);
+      sample_sizes.push_back(glossary.size());
+      if (samples.size() >= GLOSSARY_SAMPLE_BUDGET) {
+        break;
+      }
+    }
+  }
+  buffers.release(std::move(content));
+
+  if (sample_sizes.size() < GLOSSARY_MIN_SAMPLES) {
+    return {};
+  }
+
+  std::vector<char> dict(GLOSSARY_DICT_CAPACITY);
+  const size_t dict_size = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(), sample_sizes.data(),
+                                                 static_cast<unsigned>(sample_sizes.size()));
+  if (ZDICT_isError(dict_size)) {
+    return {};
+  }
+  dict.resize(dict_size);
+  return dict;
+}
+
+// compress stage, glossaries are split into chunks so idle workers can steal them from large banks
+std::vector<std::vector<char>> compress_glossaries(thread_pool::Pool& pool,
+                                                   const std::vector<std::string_view>& glossaries,
+                                                   const ZSTD_CDict* cdict) {
+  std::vector<std::vector<char>> compressed(glossaries.size());
+  std::atomic<bool> failed = false;
+  auto compress_chunk = [&](size_t begin, size_t end) {
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    if (!cctx) {
+      failed = true;
+      return;
+    }
+    if (cdict) {
+      // the dictionary is stored alongside the blobs, so the per-frame dict id is redundant
+      ZSTD_CCtx_refCDict(cctx, cdict);
+      ZSTD_CCtx_setParameter(cctx, ZSTD_c_dictIDFlag, 0);
+    }
+
+    for (size_t i = begin; i < end; i++) {
+      const std::string_view glossary = glossaries[i];
+      auto& out = compressed[i];
+      const size_t bound = ZSTD_compressBound(glossary.size());
+      out.resize(bound);
+      const size_t compressed_size =
+          cdict ? ZSTD_compress2(cctx, out.data(), bound, glossary.data(), glossary.size())
+                : ZSTD_compressCCtx(cctx, out.data(), bound, glossary.data(), glossary.size(), 0);
+      if (ZSTD_isError(compressed_size)) {
+        failed = true;
+        break;
+      }
+      out.resize(compressed_size);
+    }
+    ZSTD_freeCCtx(cctx);
+  };
+
+  std::vector<std::future<void>> chunks;
+  for (size_t begin = 0; begin < glossaries.size(); begin += COMPRESS_CHUNK_SIZE) {
+    const size_t end = std::min(begin + COMPRESS_CHUNK_SIZE, glossaries.size());
+    chunks.push_back(pool.submit([&compress_chunk, begin, end]() { compress_chunk(begin, end); }));
+  }
+  for (auto& chunk : chunks) {
+    pool.await(chunk);
+  }
+
+  if (failed) {
+    throw std::runtime_error("failed to compress glossary");
+  }
+  return compressed;
+}
+
+// parse stage, records are written with placeholder glossary offsets that the writer patches
+ProcessedFile process_term_bank(thread_pool::Pool& pool, const std::string& content, const ZSTD_CDict* cdict,
+                                const TagTable& tags, bool index_glossaries) {
   ProcessedFile processed;
   if (content.empty()) {
     return processed;
@@ -208,36 +463,27 @@ ProcessedFile process_term_bank(const std::string& content) {
     return processed;
   }
 
-  std::vector<char> compressed;
-  ZSTD_CCtx* cctx = ZSTD_createCCtx();
-  if (!cctx) {
-    return processed;
-  }
-
+  BankTags bank_tags(tags);
+  TagCache tag_cache;
+  std::vector<std::string_view> unique_glossaries;
+  std::vector<uint64_t> unique_hashes;
+  ankerl::unordered_dense::set<uint64_t> seen;
   for (auto& term : out) {
+    std::string_view expr = term.expression;
+    std::string_view reading = term.reading.empty() ? expr : term.reading;
+    if (!fits_key(expr) || !fits_key(reading)) {
+      continue;
+    }
     const std::string_view glossary = term.glossary.str;
     uint64_t glossary_hash = XXH3_64bits(glossary.data(), glossary.size());
-    auto it = processed.glossaries.find(glossary_hash);
-    if (it == processed.glossaries.end()) {
-      const size_t bound = ZSTD_compressBound(glossary.size());
-      compressed.resize(bound);
-      const size_t compressed_size =
-          ZSTD_compressCCtx(cctx, compressed.data(), bound, glossary.data(), glossary.size(), 0);
-      if (ZSTD_isError(compressed_size)) {
-        ZSTD_freeCCtx(cctx);
-        throw std::runtime_error("failed to compress glossary");
-      }
-      compressed.resize(compressed_size);
-      processed.glossaries.emplace(glossary_hash, compressed);
+    if (seen.insert(glossary_hash).second) {
+      unique_glossaries.push_back(glossary);
+      unique_hashes.push_back(glossary_hash);
     }
 
     uint64_t offset = processed.data.size();
-    uint32_t blob_size = processed.glossaries[glossary_hash].size();
-    std::string_view expr = term.expression;
-    std::string_view reading = term.reading.empty() ? expr : term.reading;
     std::string_view definition_tags = term.definition_tags.value_or("");
 
-    write_u8(processed.data, 0);
     write_u16(processed.data, expr.size());
     write_str(processed.data, expr);
     write_u16(processed.data, reading.size());
@@ -245,28 +491,46 @@ ProcessedFile process_term_bank(const std::string& content) {
 
     uint64_t glossary_offset = processed.data.size();
     write_u64(processed.data, 0);
-    write_u32(processed.data, blob_size);
+    write_u32(processed.data, 0);
     processed.glossary_offsets.emplace_back(glossary_offset, glossary_hash);
 
-    write_u8(processed.data, definition_tags.size());
-    write_str(processed.data, definition_tags);
+    write_tag_ids(processed.data, definition_tags, bank_tags, tag_cache);
     write_u8(processed.data, term.rules.size());
     write_str(processed.data, term.rules);
-    write_u8(processed.data, term.term_tags.size());
-    write_str(processed.data, term.term_tags);
+    write_tag_ids(processed.data, term.term_tags, bank_tags, tag_cache);
 
-    processed.term_offsets[std::string(expr)].push_back(offset);
+    processed.keys.emplace_back(expr, offset);
     if (reading != expr) {
-      processed.term_offsets[std::string(reading)].push_back(offset);
+      processed.keys.emplace_back(reading, offset);
+    }
+    if (index_glossaries) {
+      for (auto& token : glossary_index::tokenize_glossary(glossary)) {
+        if (fits_key(token)) {
+          processed.tokens.emplace_back(std::move(token), offset);
+        }
+      }
     }
     processed.count++;
   }
-  ZSTD_freeCCtx(cctx);
+
+  auto compressed = compress_glossaries(pool, unique_glossaries, cdict);
+  for (size_t i = 0; i < compressed.size(); i++) {
+    processed.glossaries.emplace(unique_hashes[i], std::move(compressed[i]));
+  }
+  bank_tags.finish(processed);
 
   return processed;
 }
 
-ProcessedFile process_meta_bank(const std::string& content) {
+void write_pitch_positions(std::vector<char>& out, const std::vector<int>& positions) {
+  const size_t count = std::min<size_t>(positions.size(), UINT8_MAX);
+  write_u8(out, count);
+  for (size_t i = 0; i < count; i++) {
+    write_u8(out, positions[i]);
+  }
+}
+
+ProcessedFile process_meta_bank(const std::string& content, const TagTable& tags) {
   ProcessedFile processed;
   if (content.empty()) {
     return processed;
@@ -277,38 +541,100 @@ ProcessedFile process_meta_bank(const std::string& content) {
     return processed;
   }
 
+  // frequency and pitch data is decoded here once, so queries never have to parse json
+  BankTags bank_tags(tags);
   for (auto& meta : out) {
     uint64_t offset = processed.data.size();
     std::string_view expr = meta.expression;
-    std::string_view mode = meta.mode;
     std::string_view data = meta.data.str;
+    if (!fits_key(expr)) {
+      continue;
+    }
 
-    write_u8(processed.data, 1);
-    write_u16(processed.data, expr.size());
-    write_str(processed.data, expr);
-    write_u8(processed.data, mode.size());
-    write_str(processed.data, mode);
-    write_u32(processed.data, data.size());
-    write_str(processed.data, data);
+    if (meta.mode == "freq") {
+      ParsedFrequency parsed;
+      if (!yomitan_parser::parse_frequency(data, parsed) || !fits_key(parsed.reading)) {
+        continue;
+      }
+      // display values equal to the plain value are rebuilt at query time
+      std::string_view display_value = parsed.display_value;
+      if (display_value == std::to_string(parsed.value)) {
+        display_value = "";
+      }
+
+      write_u16(processed.data, expr.size());
+      write_str(processed.data, expr);
+      write_u8(processed.data, 0);
+      write_u16(processed.data, parsed.reading.size());
+      write_str(processed.data, parsed.reading);
+      write_u32(processed.data, static_cast<uint32_t>(parsed.value));
+      write_u16(processed.data, display_value.size());
+      write_str(processed.data, display_value);
+    } else if (meta.mode == "pitch") {
+      ParsedPitch parsed;
+      if (!yomitan_parser::parse_pitch(data, parsed) || parsed.pitches.empty() || !fits_key(parsed.reading)) {
+        continue;
+      }
 
-    processed.term_offsets[std::string(expr)].push_back(offset);
+      write_u16(processed.data, expr.size());
+      write_str(processed.data, expr);
+      write_u8(processed.data, 1);
+      write_u16(processed.data, parsed.reading.size());
+      write_str(processed.data, parsed.reading);
+      const size_t pitch_count = std::min<size_t>(parsed.pitches.size(), UINT8_MAX);
+      write_u8(processed.data, pitch_count);
+      for (const auto& pitch : parsed.pitches | std::views::take(pitch_count)) {
+        write_u32(processed.data, static_cast<uint32_t>(pitch.position));
+        write_pitch_positions(processed.data, pitch.nasal);
+        write_pitch_positions(processed.data, pitch.devoice);
+        std::vector<uint32_t> tag_ids;
+        for (const auto& tag : pitch.tags) {
+          tag_ids.push_back(bank_tags.resolve(tag));
+        }
+        bank_tags.write(processed.data, tag_ids);
+      }
+    } else {
+      continue;
+    }
+
+    processed.keys.emplace_back(expr, offset);
     processed.count++;
   }
+  bank_tags.finish(processed);
 
   return processed;
 }
 
-void write_terms(std::ofstream& file, ankerl::unordered_dense::map<std::string, std::vector<uint64_t>>& offsets,
-                 const std::string& zip_path, const std::vector<int>& files, uint64_t& write_offset,
-                 ImportResult& result, bool low_ram) {
-  if (files.empty()) {
-    return;
-  }
+// hands bank results to the writer in submission order while later banks keep running on the pool
+template <typename Result, typename Process, typename Write>
+void run_ordered(const Pipeline& pipeline, const std::vector<size_t>& files, Process&& process, Write&& write) {
+  std::deque<std::future<Result>> in_flight;
+  try {
+    for (size_t file_index : files) {
+      in_flight.push_back(pipeline.pool.submit([&process, file_index]() { return process(file_index); }));
+      if (in_flight.size() >= pipeline.window) {
+        write(in_flight.front().get());
+        in_flight.pop_front();
+      }
+    }
 
-  size_t max_threads =
-      low_ram ? 3 : std::max<size_t>(4, static_cast<const unsigned long>(std::thread::hardware_concurrency() * 2));
-  std::deque<std::future<ProcessedFile>> threads;
+    while (!in_flight.empty()) {
+      write(in_flight.front().get());
+      in_flight.pop_front();
+    }
+  } catch (...) {
+    // tasks still reference the caller's state
+    for (auto& future : in_flight) {
+      future.wait();
+    }
+    throw;
+  }
+}
 
+// token_index is null unless glossaries are indexed
+void write_terms(const Pipeline& pipeline, std::ostream& file, postings::Builder& index,
+                 postings::Builder* token_index, const std::vector<size_t>& files, const ZSTD_CDict* cdict,
+                 TagTable& tags, uint64_t& write_offset, ImportResult& result) {
   ankerl::unordered_dense::map<uint64_t, uint64_t> glossaries;
   auto write_processed = [&](ProcessedFile&& processed) {
     if (processed.data.empty()) {
@@ -329,135 +655,323 @@ void write_terms(std::ofstream& file, ankerl::unordered_dense::map<std::string,
 
     for (auto& [pos, hash] : processed.glossary_offsets) {
       uint64_t glossary_offset = glossaries[hash];
+      auto glossary_size = static_cast<uint32_t>(processed.glossaries[hash].size());
       std::memcpy(processed.data.data() + pos, &glossary_offset, sizeof(uint64_t));
+      std::memcpy(processed.data.data() + pos + sizeof(uint64_t), &glossary_size, sizeof(uint32_t));
     }
 
+    resolve_missing_tags(processed, tags);
     file.write(processed.data.data(), static_cast<std::streamsize>(processed.data.size()));
-    merge_offsets(offsets, processed.term_offsets, write_offset);
+    add_keys(index, processed, write_offset);
+    if (token_index) {
+      for (const auto& [token, offset] : processed.tokens) {
+        token_index->add(token, offset + write_offset);
+      }
+    }
     write_offset += processed.data.size();
     result.term_count += processed.count;
   };
 
-  for (int file_index : files) {
-    threads.push_back(std::async(std::launch::async, [&zip_path, file_index]() {
-      zip_t* archive = zip_open(zip_path.c_str(), 0, 'r');
-      if (!archive) {
-        return ProcessedFile{};
-      }
-      std::string content = read_file_by_index(archive, file_index);
-      zip_close(archive);
-      return process_term_bank(content);
-    }));
-
-    if (threads.size() == max_threads) {
-      write_processed(threads.front().get());
-      threads.pop_front();
-    }
-  }
-
-  while (!threads.empty()) {
-    write_processed(threads.front().get());
-    threads.pop_front();
-  }
+  run_ordered<ProcessedFile>(
+      pipeline, files,
+      [&](size_t file_index) {
+        std::string content = pipeline.buffers.acquire();
+        ProcessedFile processed;
+        if (pipeline.reader.read(file_index, content)) {
+          processed = process_term_bank(pipeline.pool, content, cdict, tags, token_index != nullptr);
+        }
+        pipeline.buffers.release(std::move(content));
+        return processed;
+      },
+      write_processed);
 }
 
-void write_meta(std::ofstream& file, ankerl::unordered_dense::map<std::string, std::vector<uint64_t>>& offsets,
-                const std::string& zip_path, const std::vector<int>& files, uint64_t& write_offset,
-                ImportResult& result, bool low_ram) {
-  if (files.empty()) {
-    return;
-  }
-
-  size_t max_threads =
-      low_ram ? 3 : std::max<size_t>(4, static_cast<const unsigned long>(std::thread::hardware_concurrency() * 2));
-  std::deque<std::future<ProcessedFile>> threads;
+void write_meta(const Pipeline& pipeline, std::ostream& file, postings::Builder& index,
+                const std::vector<size_t>& files, TagTable& tags, uint64_t& write_offset, ImportResult& result) {
   auto write_processed = [&](ProcessedFile&& processed) {
     if (processed.data.empty()) {
       return;
     }
+    resolve_missing_tags(processed, tags);
     file.write(processed.data.data(), static_cast<std::streamsize>(processed.data.size()));
-    merge_offsets(offsets, processed.term_offsets, write_offset);
+    add_keys(index, processed, write_offset);
     write_offset += processed.data.size();
     result.meta_count += processed.count;
   };
 
-  for (int file_index : files) {
-    threads.push_back(std::async(std::launch::async, [&zip_path, file_index]() {
-      zip_t* archive = zip_open(zip_path.c_str(), 0, 'r');
-      if (!archive) {
-        return ProcessedFile{};
-      }
-      std::string content = read_file_by_index(archive, file_index);
-      zip_close(archive);
-      return process_meta_bank(content);
-    }));
+  run_ordered<ProcessedFile>(
+      pipeline, files,
+      [&](size_t file_index) {
+        std::string content = pipeline.buffers.acquire();
+        ProcessedFile processed;
+        if (pipeline.reader.read(file_index, content)) {
+          processed = process_meta_bank(content, tags);
+        }
+        pipeline.buffers.release(std::move(content));
+        return processed;
+      },
+      write_processed);
+}
 
-    if (threads.size() == max_threads) {
-      write_processed(threads.front().get());
-      threads.pop_front();
+// sections finished while the blobs section is still open. they go to temp files next to the dictionary and are
+// copied into the container once the blobs are closed, so finished key indexes don't stay in memory
+class PendingSections {
+ public:
+  explicit PendingSections(std::string temp_prefix) : temp_prefix_(std::move(temp_prefix)) {}
+  ~PendingSections() {
+    std::error_code ec;
+    for (const auto& [id, path] : files_) {
+      std::filesystem::remove(path, ec);
     }
   }
 
-  while (!threads.empty()) {
-    write_processed(threads.front().get());
-    threads.pop_front();
+  PendingSections(const PendingSections&) = delete;
+  PendingSections& operator=(const PendingSections&) = delete;
+
+  const std::string& temp_prefix() const { return temp_prefix_; }
+
+  // the stream has to be closed before write_to, which surfaces write errors
+  std::ofstream open(container::Section id) {
+    const auto& [_, path] =
+        files_.emplace_back(id, temp_prefix_ + "." + std::to_string(static_cast<uint32_t>(id)) + ".tmp");
+    std::ofstream out;
+    out.exceptions(std::ios::failbit | std::ios::badbit);
+    out.open(path, std::ios::binary | std::ios::trunc);
+    return out;
+  }
+
+  void add(container::Section id, std::span<const char> data) {
+    std::ofstream out = open(id);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.close();
   }
-}
 
-void write_offset_index(std::ostream& file, ankerl::unordered_dense::map<std::string, std::vector<uint64_t>>& offsets,
-                        uint64_t& write_offset, std::vector<std::string_view>& keys,
-                        std::vector<uint64_t>& key_offsets) {
+  // copies the sections in the order they were opened
+  void write_to(container::Writer& writer) const {
+    for (const auto& [id, path] : files_) {
+      std::ifstream in(path, std::ios::binary);
+      if (!in) {
+        throw std::runtime_error("failed to read back a key index section");
+      }
+      writer.add(id, in);
+    }
+  }
+
+ private:
+  std::string temp_prefix_;
+  std::vector<std::pair<container::Section, std::filesystem::path>> files_;
+};
+
+// calls fn(key, offset) with the blob offset of the posting list of every key, in key order
+template <typename Fn>
+void write_offset_index(std::ostream& file, postings::Builder& index, uint64_t& write_offset, Fn&& fn) {
   std::vector<char> offset_buf;
-  for (auto& [key, offs] : offsets) {
-    keys.push_back(key);
-    key_offsets.push_back(write_offset);
+  auto flush = [&]() {
+    file.write(offset_buf.data(), static_cast<std::streamsize>(offset_buf.size()));
+    offset_buf.clear();
+  };
+
+  // posting list: varint count, then the ascending record offsets as varint deltas
+  index.finish([&](std::string_view key, std::span<const uint64_t> offs) {
+    fn(key, write_offset);
+
+    const size_t old_size = offset_buf.size();
+    write_varint(offset_buf, offs.size());
+    uint64_t previous = 0;
+    for (uint64_t offset : offs) {
+      write_varint(offset_buf, offset - previous);
+      previous = offset;
+    }
 
-    write_u32(offset_buf, offs.size());
-    write_bytes(offset_buf, offs.data(), offs.size() * sizeof(uint64_t));
+    write_offset += offset_buf.size() - old_size;
+    if (offset_buf.size() >= WRITE_BUFFER_SIZE) {
+      flush();
+    }
+  });
+  flush();
+}
 
-    write_offset += sizeof(uint32_t) + offs.size() * sizeof(uint64_t);
+// container sections of a key index, sorted keys and suffixes are only written for terms
+struct KeyIndexSections {
+  container::Section phf;
+  // slot -> posting list offset, every slot also carries the fingerprint of its key
+  container::Section offsets;
+  // u16 length + key per slot, in slot order
+  container::Section keys;
+  // front coded keys in key order, mapping to the same posting lists
+  std::optional<container::Section> sorted_keys = std::nullopt;
+  // front coded code point suffixes of all keys, mapping to the position of their key in sorted_keys
+  std::optional<container::Section> suffixes = std::nullopt;
+};
+
+// writes the posting lists of a section to the blobs and its key index to pending sections. sorted keys are
+// streamed as keys come out of the builder and suffixes are sorted by a builder of their own within budget, only the
+// hash and slot tables are sized by the unique key count and sit outside it. the phf is built on threads threads
+void write_key_index(std::ostream& blobs, postings::Builder& index, uint64_t& write_offset,
+                     const KeyIndexSections& sections, PendingSections& pending, size_t budget, size_t threads) {
+  std::ofstream sorted_out;
+  if (sections.sorted_keys) {
+    sorted_out = pending.open(*sections.sorted_keys);
+  }
+  sorted_keys::Writer sorted(sorted_out);
+  std::vector<uint64_t> key_offsets;
+  write_offset_index(blobs, index, write_offset, [&](std::string_view key, uint64_t offset) {
+    key_offsets.push_back(offset);
+    if (sections.sorted_keys) {
+      sorted.add(key, offset);
+    }
+  });
+  if (sections.sorted_keys) {
+    sorted.finish();
+    sorted_out.close();
+  }
+  const auto& keys = index.keys();
+
+  hash::mphf phf;
+  phf.build(keys, threads);
+  std::vector<char> phf_data;
+  phf.save(phf_data);
+  pending.add(sections.phf, phf_data);
+
+  if (write_offset > hash::SLOT_OFFSET_MASK) {
+    throw std::runtime_error("dictionary exceeds the key index offset range");
+  }
+  std::vector<uint32_t> slot_keys(keys.size());
+  {
+    std::vector<uint64_t> offset_hash_table(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      const uint64_t slot = phf(keys[i]);
+      offset_hash_table[slot] = key_offsets[i] | hash::slot_fingerprint(keys[i]);
+      slot_keys[slot] = static_cast<uint32_t>(i);
+    }
+    pending.add(sections.offsets, {reinterpret_cast<const char*>(offset_hash_table.data()),
+                                   offset_hash_table.size() * sizeof(uint64_t)});
+  }
+  std::vector<uint64_t>().swap(key_offsets);
+
+  std::ofstream keys_out = pending.open(sections.keys);
+  std::vector<char> keys_buf;
+  for (uint32_t i : slot_keys) {
+    write_u16(keys_buf, keys[i].size());
+    write_str(keys_buf, keys[i]);
+    if (keys_buf.size() >= WRITE_BUFFER_SIZE) {
+      keys_out.write(keys_buf.data(), static_cast<std::streamsize>(keys_buf.size()));
+      keys_buf.clear();
+    }
+  }
+  keys_out.write(keys_buf.data(), static_cast<std::streamsize>(keys_buf.size()));
+  keys_out.close();
+
+  if (sections.suffixes) {
+    // the builder emits keys in sorted order, so a key's position in sorted_keys is its index
+    postings::Builder suffixes(pending.temp_prefix() + ".suffixes", budget, false);
+    for (size_t i = 0; i < keys.size(); i++) {
+      for (size_t pos = 0; pos < keys[i].size(); pos++) {
+        // suffixes start at utf-8 lead bytes
+        if ((static_cast<uint8_t>(keys[i][pos]) & 0xc0) != 0x80) {
+          suffixes.add(keys[i].substr(pos), i);
+        }
+      }
+    }
+    std::ofstream suffix_out = pending.open(*sections.suffixes);
+    sorted_keys::Writer suffix_writer(suffix_out);
+    suffixes.finish([&](std::string_view suffix, std::span<const uint64_t> positions) {
+      for (uint64_t position : positions) {
+        suffix_writer.add(suffix, position);
+      }
+    });
+    suffix_writer.finish();
+    suffix_out.close();
   }
-  file.write(offset_buf.data(), static_cast<std::streamsize>(offset_buf.size()));
 }
 
-void write_media(const std::string& path, zip_t* archive, const std::vector<int>& files, ImportResult& result) {
+// writes the posting lists of glossary tokens to the blobs. tokens are only looked up by the search, not by
+// every lookup, so they get a front coded sorted key array instead of a hash index
+void write_token_index(std::ostream& blobs, postings::Builder& index, uint64_t& write_offset,
+                       PendingSections& pending) {
+  std::ofstream out = pending.open(container::Section::glossary_tokens);
+  sorted_keys::Writer tokens(out);
+  write_offset_index(blobs, index, write_offset,
+                     [&](std::string_view key, uint64_t offset) { tokens.add(key, offset); });
+  tokens.finish();
+  out.close();
+}
+
+void write_media(const Pipeline& pipeline, container::Writer& writer, const std::vector<size_t>& files,
+                 ImportResult& result) {
   if (files.empty()) {
     return;
   }
 
-  std::ofstream media(path + "/media.bin", std::ios::binary);
-  setup_stream_exceptions(media);
-
-  std::vector<char> blobs_buf;
-  for (int file_index : files) {
-    auto media = read_media_by_index(archive, file_index);
-    if (!media.has_value()) {
-      continue;
+  std::ostream& media = writer.begin(container::Section::media);
+
+  std::vector<std::string_view> media_paths;
+  std::vector<uint64_t> media_offsets;
+  uint64_t write_offset = 0;
+  std::vector<char> header_buf;
+  auto write_file = [&](MediaFile&& file) {
+    if (file.read) {
+      const std::string_view media_path = pipeline.reader.entries()[file.index].name;
+      media_paths.push_back(media_path);
+      media_offsets.push_back(write_offset);
+
+      header_buf.clear();
+      write_u16(header_buf, media_path.size());
+      write_str(header_buf, media_path);
+      write_u32(header_buf, file.blob.size());
+      media.write(header_buf.data(), static_cast<std::streamsize>(header_buf.size()));
+      media.write(file.blob.data(), static_cast<std::streamsize>(file.blob.size()));
+      write_offset += header_buf.size() + file.blob.size();
+      result.media_count++;
     }
+    pipeline.buffers.release(std::move(file.blob));
+  };
 
-    const auto blob_size = media->blob.size();
-    write_u16(blobs_buf, media->path.size());
-    write_str(blobs_buf, media->path);
-    write_u32(blobs_buf, blob_size);
-    write_bytes(blobs_buf, media->blob.data(), blob_size);
+  run_ordered<MediaFile>(
+      pipeline, files,
+      [&](size_t file_index) {
+        MediaFile file{.index = file_index, .blob = pipeline.buffers.acquire(), .read = false};
+        file.read = pipeline.reader.read(file_index, file.blob);
+        return file;
+      },
+      write_file);
+  writer.end();
+
+  if (media_paths.empty()) {
+    return;
+  }
 
-    result.media_count++;
+  // persisted lookup table, so loading a dictionary doesn't depend on the amount of media
+  hash::mphf phf;
+  phf.build(media_paths);
+  std::vector<char> phf_data;
+  phf.save(phf_data);
+  writer.add(container::Section::media_phf, phf_data);
+
+  std::vector<uint64_t> media_index(media_paths.size());
+  for (size_t i = 0; i < media_paths.size(); i++) {
+    media_index[phf(media_paths[i])] = media_offsets[i];
   }
-  media.write(blobs_buf.data(), static_cast<std::streamsize>(blobs_buf.size()));
+  writer.add(container::Section::media_index,
+             std::span(reinterpret_cast<const char*>(media_index.data()), media_index.size() * sizeof(uint64_t)));
 }
 }
 
 ImportResult dictionary_importer::import(const std::string& zip_path, const std::string& output_dir, bool low_ram) {
+  return import(zip_path, output_dir, ImportOptions{.low_ram = low_ram});
+}
+
+ImportResult dictionary_importer::import(const std::string& zip_path, const std::string& output_dir,
+                                         const ImportOptions& options) {
   ImportResult result;
-  zip_t* archive = nullptr;
   try {
-    archive = zip_open(zip_path.c_str(), 0, 'r');
-    if (!archive) {
-      throw std::runtime_error("failed to open zip");
+    archive::Reader reader;
+    if (!reader.open(zip_path)) {
+      throw std::runtime_error("failed to open dictionary");
     }
 
-    std::string index_content = read_file_by_name(archive, "index.json");
-    if (index_content.empty()) {
+    std::string index_content;
+    if (!reader.read("index.json", index_content) || index_content.empty()) {
       throw std::runtime_error("could not find or read index.json");
     }
 
@@ -468,71 +982,112 @@ ImportResult dictionary_importer::import(const std::string& zip_path, const std:
 
     result.title = index.title;
 
-    std::filesystem::path dict_path = std::filesystem::path(output_dir) / result.title;
-    std::string path = dict_path.string();
-    std::filesystem::create_directories(dict_path);
+    std::filesystem::create_directories(output_dir);
+    const std::filesystem::path dict_path = dict_file_path(output_dir, result.title);
+    container::Writer writer(dict_path.string());
+    writer.add(container::Section::title, index.title);
+    writer.add(container::Section::index, index_content);
 
-    if (glz::write_file_json(index, path + "/index.json", std::string{})) {
-      throw std::runtime_error("failed to write index.json");
+    std::string styles;
+    if (reader.read("styles.css", styles) && !styles.empty()) {
+      writer.add(container::Section::styles, styles);
     }
 
-    std::string styles = read_file_by_name(archive, "styles.css");
-    if (!styles.empty()) {
-      std::ofstream styles_file(path + "/styles.css", std::ios::binary);
-      setup_stream_exceptions(styles_file);
-      styles_file.write(styles.data(), static_cast<std::streamsize>(styles.size()));
+    const Files files = get_files(reader);
+    BufferPool buffers;
+    CDictPtr cdict(nullptr, ZSTD_freeCDict);
+    std::vector<char> glossary_dict = train_glossary_dict(reader, buffers, files.term_banks);
+    if (!glossary_dict.empty()) {
+      writer.add(container::Section::glossary_dict, glossary_dict);
+      cdict.reset(ZSTD_createCDict(glossary_dict.data(), glossary_dict.size(), 0));
+      if (!cdict) {
+        throw std::runtime_error("failed to create glossary dictionary");
+      }
     }
 
-    const Files files = get_files(archive);
-    std::ofstream blobs(path + "/blobs.bin", std::ios::binary);
-    setup_stream_exceptions(blobs);
-    ankerl::unordered_dense::map<std::string, std::vector<uint64_t>> offsets;
-    uint64_t write_offset = 0;
-    write_terms(blobs, offsets, zip_path, files.term_banks, write_offset, result, low_ram);
-    write_meta(blobs, offsets, zip_path, files.meta_banks, write_offset, result, low_ram);
-    if (offsets.empty()) {
-      throw std::runtime_error("empty dictionary");
+    TagTable tags;
+    read_tag_banks(reader, buffers, files.tag_banks, tags);
+
+    size_t index_budget = options.index_memory_budget;
+    if (index_budget == 0 && options.low_ram) {
+      index_budget = LOW_RAM_INDEX_BUDGET;
     }
 
-    std::vector<std::string_view> keys;
-    std::vector<uint64_t> key_offsets;
-    write_offset_index(blobs, offsets, write_offset, keys, key_offsets);
+    const size_t hardware_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    thread_pool::Pool pool(options.low_ram ? 2 : hardware_threads);
+    const Pipeline pipeline{.reader = reader,
+                            .pool = pool,
+                            .buffers = buffers,
+                            .window = options.low_ram ? 3 : std::max<size_t>(4, hardware_threads * 2)};
 
-    hash::mphf phf;
-    phf.build(keys);
-    phf.save(path + "/hash.mph");
+    std::ostream& blobs = writer.begin(container::Section::blobs);
+    uint64_t write_offset = 0;
 
-    std::vector<uint64_t> offset_hash_table(keys.size());
-    for (size_t i = 0; i < keys.size(); i++) {
-      auto& key = keys[i];
-      offset_hash_table[phf(key)] = key_offsets[i];
+    // term and meta records get separate key indexes, so each query kind only reads its own records.
+    // the term index is finished and written out before meta banks are read, only the term and glossary token
+    // builders hold memory at the same time
+    PendingSections pending(dict_path.string() + ".sections");
+    bool has_key_index = false;
+    {
+      // the term and token builders fill at the same time, so they split the budget between them
+      const size_t builder_budget =
+          options.glossary_index && index_budget > 0 ? std::max<size_t>(1, index_budget / 2) : index_budget;
+      postings::Builder term_index(dict_path.string() + ".terms", builder_budget);
+      std::optional<postings::Builder> token_index;
+      if (options.glossary_index) {
+        token_index.emplace(dict_path.string() + ".tokens", builder_budget, false);
+      }
+      write_terms(pipeline, blobs, term_index, token_index ? &*token_index : nullptr, files.term_banks, cdict.get(),
+                  tags, write_offset, result);
+      if (!term_index.empty()) {
+        const KeyIndexSections sections{
+            .phf = container::Section::term_phf,
+            .offsets = container::Section::term_offsets,
+            .keys = container::Section::term_keys,
+            .sorted_keys = container::Section::term_sorted_keys,
+            .suffixes = options.suffix_index ? std::optional(container::Section::term_suffixes) : std::nullopt};
+        write_key_index(blobs, term_index, write_offset, sections, pending, builder_budget, pool.size());
+        has_key_index = true;
+      }
+      if (token_index && !token_index->empty()) {
+        write_token_index(blobs, *token_index, write_offset, pending);
+      }
     }
-    std::ofstream offs(path + "/offsets.bin", std::ios::binary);
-    setup_stream_exceptions(offs);
-    offs.write(reinterpret_cast<const char*>(offset_hash_table.data()),
-               static_cast<std::streamsize>(offset_hash_table.size() * sizeof(uint64_t)));
-
-    ankerl::unordered_dense::map<std::string, std::vector<uint64_t>>().swap(offsets);
-    std::vector<std::string_view>().swap(keys);
-    std::vector<uint64_t>().swap(key_offsets);
+    {
+      postings::Builder meta_index(dict_path.string() + ".meta", index_budget);
+      write_meta(pipeline, blobs, meta_index, files.meta_banks, tags, write_offset, result);
+      if (!meta_index.empty()) {
+        const KeyIndexSections sections{.phf = container::Section::meta_phf,
+                                        .offsets = container::Section::meta_offsets,
+                                        .keys = container::Section::meta_keys};
+        write_key_index(blobs, meta_index, write_offset, sections, pending, index_budget, pool.size());
+        has_key_index = true;
+      }
+    }
+    writer.end();
+    if (!has_key_index) {
+      throw std::runtime_error("empty dictionary");
+    }
+    pending.write_to(writer);
 
-    write_media(path, archive, files.media_files, result);
+    if (tags.size() > 0) {
+      std::vector<char> tags_buf;
+      tags.write(tags_buf);
+      writer.add(container::Section::tags, tags_buf);
+      result.tag_count = tags.size();
+    }
 
-    std::ofstream sui(path + "/.hoshidicts_1", std::ios::binary);
-    setup_stream_exceptions(sui);
-    sui.put(phf.type());
+    write_media(pipeline, writer, files.media_files, result);
+    writer.finish();
     result.success = true;
   } catch (const std::exception& e) {
     result.success = false;
     result.errors.emplace_back(e.what());
   }
 
-  if (archive) {
-    zip_close(archive);
-  }
-
   if (!result.success && !result.title.empty()) {
-    std::filesystem::remove_all(std::filesystem::path(output_dir) / result.title);
+    std::error_code ec;
+    std::filesystem::remove(dict_file_path(output_dir, result.title), ec);
   }
 
   return result;
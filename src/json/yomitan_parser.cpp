@@ -52,6 +52,9 @@ struct RawFrequency {
 
 struct PitchesArray {
   int position = 0;
+  std::optional<std::variant<int, std::vector<int>>> nasal;
+  std::optional<std::variant<int, std::vector<int>>> devoice;
+  std::optional<std::vector<std::string>> tags;
 };
 
 struct RawPitch {
@@ -81,7 +84,8 @@ struct glz::meta<internal::RawFrequency> {
 template <>
 struct glz::meta<internal::PitchesArray> {
   using T = internal::PitchesArray;
-  static constexpr auto value = object("position", &T::position);
+  static constexpr auto value =
+      object("position", &T::position, "nasal", &T::nasal, "devoice", &T::devoice, "tags", &T::tags);
 };
 
 template <>
@@ -90,6 +94,18 @@ struct glz::meta<internal::RawPitch> {
   static constexpr auto value = object("reading", glz::raw_string<&T::reading>, "pitches", &T::pitches);
 };
 
+namespace {
+std::vector<int> flatten_positions(const std::optional<std::variant<int, std::vector<int>>>& positions) {
+  if (!positions.has_value()) {
+    return {};
+  }
+  if (std::holds_alternative<int>(*positions)) {
+    return {std::get<int>(*positions)};
+  }
+  return std::get<std::vector<int>>(*positions);
+}
+}
+
 bool yomitan_parser::parse_index(std::string_view content, Index& out) {
   auto error = glz::read<glz::opts{.error_on_unknown_keys = false, .error_on_missing_keys = false}>(out, content);
   return !error;
@@ -157,7 +173,12 @@ bool yomitan_parser::parse_pitch(std::string_view content, ParsedPitch& out) {
   }
 
   out.reading = parsed.reading;
-  out.pitches =
-      parsed.pitches | std::views::transform(&internal::PitchesArray::position) | std::ranges::to<std::vector>();
+  out.pitches = parsed.pitches | std::views::transform([](auto& pitch) {
+                  return ParsedPitchAccent{.position = pitch.position,
+                                           .nasal = flatten_positions(pitch.nasal),
+                                           .devoice = flatten_positions(pitch.devoice),
+                                           .tags = std::move(pitch.tags).value_or(std::vector<std::string>{})};
+                }) |
+                std::ranges::to<std::vector>();
   return true;
 }
\ No newline at end of file
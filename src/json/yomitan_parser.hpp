@@ -45,9 +45,16 @@ struct ParsedFrequency {
   std::string display_value;
 };
 
+struct ParsedPitchAccent {
+  int position = 0;
+  std::vector<int> nasal;
+  std::vector<int> devoice;
+  std::vector<std::string> tags;
+};
+
 struct ParsedPitch {
   std::string_view reading;
-  std::vector<int> pitches;
+  std::vector<ParsedPitchAccent> pitches;
 };
 
 namespace yomitan_parser {
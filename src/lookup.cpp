@@ -3,42 +3,37 @@
 #include <utf8.h>
 
 #include <algorithm>
+#include <iterator>
 #include <map>
+#include <memory_resource>
 #include <ranges>
-#include <sstream>
+#include <string_view>
 
 #include "text_processor/text_processor.hpp"
 
 namespace {
-std::vector<std::string> split_whitespace(const std::string& str) {
-  std::vector<std::string> result;
-  std::istringstream iss(str);
-  std::string token;
-  while (iss >> token) {
-    result.push_back(std::move(token));
-  }
-  return result;
-}
-
-int get_freq_value_for_dict(const TermResult& term, const std::string& dict_name) {
-  for (const auto& frequency_entry : term.frequencies) {
-    if (frequency_entry.dict_name != dict_name) {
-      continue;
-    }
-
-    int min_frequency = INT_MAX;
-    for (const auto& frequency : frequency_entry.frequencies) {
-      if (frequency.value >= 0) {
-        min_frequency = std::min(min_frequency, frequency.value);
-      }
+// initial block of the arena of a lookup without caller provided arena, enough for common lookups
+constexpr size_t INITIAL_ARENA_SIZE = 64 * 1024;
+
+// lookup candidates point into the query context until the surviving results are copied out
+struct Candidate {
+  std::string_view matched;
+  const DeinflectionResult* deinflection;
+  TermView term;
+  int preprocessor_steps;
+};
+
+int get_freq_value_for_dict(const TermView& term, const std::string& dict_name) {
+  int min_frequency = INT_MAX;
+  for (const auto& frequency : term.frequencies) {
+    if (frequency.dict_name == dict_name && frequency.value >= 0) {
+      min_frequency = std::min(min_frequency, frequency.value);
     }
-    return min_frequency;
   }
-
-  return INT_MAX;
+  return min_frequency;
 }
 
-bool freq_sort_order(const LookupResult& a, const LookupResult& b, const std::vector<std::string>& freq_dict_order) {
+bool freq_sort_order(const Candidate& a, const Candidate& b, const std::vector<std::string>& freq_dict_order) {
   for (const auto& dict_name : freq_dict_order) {
     const int freq_a = get_freq_value_for_dict(a.term, dict_name);
     const int freq_b = get_freq_value_for_dict(b.term, dict_name);
@@ -52,7 +47,24 @@ bool freq_sort_order(const LookupResult& a, const LookupResult& b, const std::ve
 }
 
 std::vector<LookupResult> Lookup::lookup(const std::string& lookup_string, int max_results, size_t scan_length) const {
-  std::map<std::pair<std::string, std::string>, LookupResult> result_map;
+  std::pmr::monotonic_buffer_resource arena(INITIAL_ARENA_SIZE);
+  return lookup(lookup_string, &arena, max_results, scan_length);
+}
+
+std::vector<LookupResult> Lookup::lookup(const std::string& lookup_string, std::pmr::memory_resource* arena,
+                                         int max_results, size_t scan_length) const {
+  QueryContext context(arena);
+  std::pmr::map<std::pair<std::string_view, std::string_view>, Candidate> result_map(arena);
+
+  // every deinflection of every substring is queried in one batch, then handled in scan order
+  struct Probe {
+    std::string_view matched;
+    int preprocessor_steps;
+    const DeinflectionResult* deinflection;
+  };
+  std::pmr::vector<std::pmr::vector<DeinflectionResult>> deinflections(arena);
+  std::pmr::vector<Probe> probes(arena);
+  std::pmr::vector<std::string_view> keys(arena);
 
   size_t text_len = utf8::distance(lookup_string.begin(), lookup_string.end());
   size_t start = std::min(scan_length, text_len);
@@ -60,36 +72,15 @@ std::vector<LookupResult> Lookup::lookup(const std::string& lookup_string, int m
   utf8::advance(search_str_it, start, lookup_string.end());
 
   for (size_t i = std::min(scan_length, text_len); i > 0; i--) {
-    std::string search_str(lookup_string.begin(), search_str_it);
-    auto processor_results = text_processor::process(search_str);
+    std::string_view search_str(lookup_string.begin(), search_str_it);
+    auto processor_results = text_processor::process(search_str, arena);
     for (auto& variant : processor_results) {
-      auto deinflection_results = deinflector_.deinflect(variant.text);
-      for (auto& deinflection : deinflection_results) {
-        auto terms = query_.query(deinflection.text);
-        filter_by_pos(terms, deinflection);
-
-        for (const auto& term : terms) {
-          // deduplicate glossaries
-          auto key = std::make_pair(term.expression, term.reading);
-          auto it = result_map.find(key);
-          if (it != result_map.end()) {
-            // we only need the longest matched form
-            if (utf8::distance(search_str.begin(), search_str.end()) >
-                utf8::distance(it->second.matched.begin(), it->second.matched.end())) {
-              it->second = LookupResult{.matched = search_str,
-                                        .deinflected = deinflection.text,
-                                        .trace = deinflection.trace,
-                                        .term = term,
-                                        .preprocessor_steps = variant.steps};
-            }
-          } else {
-            result_map.emplace(key, LookupResult{.matched = search_str,
-                                                 .deinflected = deinflection.text,
-                                                 .trace = deinflection.trace,
-                                                 .term = term,
-                                                 .preprocessor_steps = variant.steps});
-          }
-        }
+      // inner vectors keep their elements in place when the outer one grows
+      const auto& results = deinflections.emplace_back(deinflector_.deinflect(variant.text, arena));
+      for (const auto& deinflection : results) {
+        probes.push_back(
+            Probe{.matched = search_str, .preprocessor_steps = variant.steps, .deinflection = &deinflection});
+        keys.push_back(deinflection.text);
       }
     }
     if (i > 1) {
@@ -97,10 +88,32 @@ std::vector<LookupResult> Lookup::lookup(const std::string& lookup_string, int m
     }
   }
 
-  auto results = result_map | std::views::values | std::views::as_rvalue | std::ranges::to<std::vector>();
+  const auto batch = query_.query_batch(keys, context);
+  for (size_t i = 0; i < probes.size(); i++) {
+    const auto& [matched, preprocessor_steps, deinflection] = probes[i];
+    for (const auto& term : batch[i]) {
+      if (!matches_pos(term, *deinflection)) {
+        continue;
+      }
+
+      // deduplicate glossaries
+      Candidate candidate{
+          .matched = matched, .deinflection = deinflection, .term = term, .preprocessor_steps = preprocessor_steps};
+      auto [it, inserted] = result_map.try_emplace(std::make_pair(term.expression, term.reading), candidate);
+      // we only need the longest matched form
+      if (!inserted && utf8::distance(matched.begin(), matched.end()) >
+                           utf8::distance(it->second.matched.begin(), it->second.matched.end())) {
+        it->second = candidate;
+      }
+    }
+  }
+
+  std::pmr::vector<Candidate> candidates(arena);
+  candidates.reserve(result_map.size());
+  std::ranges::copy(result_map | std::views::values, std::back_inserter(candidates));
   const auto freq_dict_order = query_.get_freq_dict_order();
-  auto middle_iter = std::ranges::next(results.begin(), max_results, results.end());
-  std::ranges::partial_sort(results, middle_iter, [&freq_dict_order](const auto& a, const auto& b) {
+  auto middle_iter = std::ranges::next(candidates.begin(), max_results, candidates.end());
+  std::ranges::partial_sort(candidates, middle_iter, [&freq_dict_order](const auto& a, const auto& b) {
     auto len_a = utf8::distance(a.matched.begin(), a.matched.end());
     auto len_b = utf8::distance(b.matched.begin(), b.matched.end());
     if (len_a != len_b) {
@@ -113,8 +126,8 @@ std::vector<LookupResult> Lookup::lookup(const std::string& lookup_string, int m
       return steps_a < steps_b;
     }
 
-    auto trace_len_a = a.trace.size();
-    auto trace_len_b = b.trace.size();
+    auto trace_len_a = a.deinflection->trace.size();
+    auto trace_len_b = b.deinflection->trace.size();
     if (trace_len_a != trace_len_b) {
       return trace_len_a < trace_len_b;
     }
@@ -122,19 +135,27 @@ std::vector<LookupResult> Lookup::lookup(const std::string& lookup_string, int m
     return freq_sort_order(a, b, freq_dict_order);
   });
 
-  if (results.size() > static_cast<size_t>(max_results)) {
-    results.resize(max_results);
+  // only the returned results are copied and have their glossaries decompressed
+  std::vector<LookupResult> results;
+  results.reserve(std::ranges::distance(candidates.begin(), middle_iter));
+  for (auto& candidate : std::ranges::subrange(candidates.begin(), middle_iter)) {
+    results.push_back(LookupResult{.matched = std::string(candidate.matched),
+                                   .deinflected = std::string(candidate.deinflection->text),
+                                   .trace = candidate.deinflection->trace |
+                                            std::views::transform([](const TransformGroup* group) { return *group; }) |
+                                            std::ranges::to<std::vector>(),
+                                   .term = query_.to_result(candidate.term),
+                                   .preprocessor_steps = candidate.preprocessor_steps});
   }
 
   return results;
 }
 
-void Lookup::filter_by_pos(std::vector<TermResult>& terms, const DeinflectionResult& d) {
+bool Lookup::matches_pos(const TermView& term, const DeinflectionResult& d) {
   if (d.conditions == 0) {
-    return;
+    return true;
   }
-  std::erase_if(terms, [&](const TermResult& term) {
-    auto dict_conditions = Deinflector::pos_to_conditions(split_whitespace(term.rules));
-    return (dict_conditions & d.conditions) == 0;
-  });
+  // rules are parsed in place, this runs for every candidate of every lookup
+  auto dict_conditions = Deinflector::pos_to_conditions(term.rules);
+  return (dict_conditions & d.conditions) != 0;
 }
@@ -0,0 +1,315 @@
+#include "postings.hpp"
+
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+namespace {
+// runs merged at once, more runs are merged in passes so the open streams stay bounded
+constexpr size_t MAX_MERGE_RUNS = 64;
+
+struct Pair {
+  uint64_t key_pos;
+  uint64_t offset;
+  uint32_t key_len;
+};
+
+// runs store each key once: u16 key length, key, u32 offset count, u64 offsets
+class RunReader {
+ public:
+  explicit RunReader(const std::filesystem::path& path) : in_(path, std::ios::binary) { next(); }
+
+  bool next() {
+    uint16_t key_len = 0;
+    uint32_t count = 0;
+    valid_ = static_cast<bool>(in_.read(reinterpret_cast<char*>(&key_len), sizeof(key_len)));
+    if (!valid_) {
+      return false;
+    }
+    key_.resize(key_len);
+    in_.read(key_.data(), key_len);
+    in_.read(reinterpret_cast<char*>(&count), sizeof(count));
+    offsets_.resize(count);
+    in_.read(reinterpret_cast<char*>(offsets_.data()), static_cast<std::streamsize>(count * sizeof(uint64_t)));
+    valid_ = static_cast<bool>(in_);
+    return valid_;
+  }
+
+  bool valid() const { return valid_; }
+  const std::string& key() const { return key_; }
+  const std::vector<uint64_t>& offsets() const { return offsets_; }
+
+ private:
+  std::ifstream in_;
+  std::string key_;
+  std::vector<uint64_t> offsets_;
+  bool valid_ = false;
+};
+
+void write_group(std::ofstream& out, std::string_view key, std::span<const uint64_t> offsets) {
+  const auto key_len = static_cast<uint16_t>(key.size());
+  const auto count = static_cast<uint32_t>(offsets.size());
+  out.write(reinterpret_cast<const char*>(&key_len), sizeof(key_len));
+  out.write(key.data(), key_len);
+  out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  out.write(reinterpret_cast<const char*>(offsets.data()), static_cast<std::streamsize>(count * sizeof(uint64_t)));
+}
+
+// calls fn(key, offsets) for every key of the runs in key order, offsets stay ascending because
+// ties are broken by run index and earlier runs hold smaller offsets
+template <typename Fn>
+void merge_runs(std::span<const std::filesystem::path> runs, Fn&& fn) {
+  std::vector<RunReader> readers;
+  readers.reserve(runs.size());
+  for (const auto& run : runs) {
+    readers.emplace_back(run);
+  }
+
+  auto greater = [&](size_t a, size_t b) {
+    if (readers[a].key() != readers[b].key()) {
+      return readers[a].key() > readers[b].key();
+    }
+    return a > b;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+  for (size_t i = 0; i < readers.size(); i++) {
+    if (readers[i].valid()) {
+      heap.push(i);
+    }
+  }
+
+  std::string current;
+  std::vector<uint64_t> group;
+  while (!heap.empty()) {
+    size_t top = heap.top();
+    heap.pop();
+    current = readers[top].key();
+    group.assign(readers[top].offsets().begin(), readers[top].offsets().end());
+    if (readers[top].next()) {
+      heap.push(top);
+    }
+
+    while (!heap.empty() && readers[heap.top()].key() == current) {
+      top = heap.top();
+      heap.pop();
+      group.insert(group.end(), readers[top].offsets().begin(), readers[top].offsets().end());
+      if (readers[top].next()) {
+        heap.push(top);
+      }
+    }
+    fn(std::string_view(current), std::span<const uint64_t>(group));
+  }
+}
+}
+
+namespace postings {
+struct Builder::Impl {
+  std::filesystem::path temp_prefix;
+  size_t memory_budget;
+  bool keep_keys;
+  std::vector<char> arena;
+  std::vector<Pair> pairs;
+  std::vector<std::filesystem::path> runs;
+  size_t run_count = 0;
+  std::vector<std::string_view> keys;
+
+  std::filesystem::path keys_path;
+  char* keys_data = nullptr;
+  size_t keys_size = 0;
+
+  ~Impl() {
+    if (keys_data) {
+      munmap(keys_data, keys_size);
+    }
+    std::error_code ec;
+    for (const auto& run : runs) {
+      std::filesystem::remove(run, ec);
+    }
+    if (!keys_path.empty()) {
+      std::filesystem::remove(keys_path, ec);
+    }
+  }
+
+  std::filesystem::path temp_file(const std::string& name) const {
+    return temp_prefix.string() + "." + name + ".tmp";
+  }
+
+  size_t memory_used() const { return arena.size() + pairs.size() * sizeof(Pair); }
+
+  std::string_view key(const Pair& pair) const { return {arena.data() + pair.key_pos, pair.key_len}; }
+
+  void sort_pairs() {
+    std::ranges::sort(pairs, [this](const Pair& a, const Pair& b) {
+      const auto key_a = key(a);
+      const auto key_b = key(b);
+      if (key_a != key_b) {
+        return key_a < key_b;
+      }
+      return a.offset < b.offset;
+    });
+  }
+
+  // calls fn(key, offsets) for every key of the sorted in-memory run
+  template <typename Fn>
+  void for_each_group(Fn&& fn) {
+    std::vector<uint64_t> group;
+    for (size_t i = 0; i < pairs.size();) {
+      const std::string_view current = key(pairs[i]);
+      group.clear();
+      for (; i < pairs.size() && key(pairs[i]) == current; i++) {
+        group.push_back(pairs[i].offset);
+      }
+      fn(current, group);
+    }
+  }
+
+  std::filesystem::path next_run() { return temp_file("run_" + std::to_string(run_count++)); }
+
+  void spill() {
+    sort_pairs();
+    auto path = next_run();
+    std::ofstream out(path, std::ios::binary);
+    out.exceptions(std::ios::failbit | std::ios::badbit);
+    runs.push_back(path);
+
+    for_each_group([&](std::string_view key, const std::vector<uint64_t>& offsets) { write_group(out, key, offsets); });
+
+    arena.clear();
+    pairs.clear();
+  }
+
+  // merges neighbouring runs in passes until the final merge fits MAX_MERGE_RUNS, keeping the run order
+  void reduce_runs() {
+    std::error_code ec;
+    while (runs.size() > MAX_MERGE_RUNS) {
+      std::vector<std::filesystem::path> merged;
+      for (size_t first = 0; first < runs.size(); first += MAX_MERGE_RUNS) {
+        const auto group = std::span(runs).subspan(first, std::min(MAX_MERGE_RUNS, runs.size() - first));
+        auto path = next_run();
+        std::ofstream out(path, std::ios::binary);
+        out.exceptions(std::ios::failbit | std::ios::badbit);
+        merged.push_back(path);
+        merge_runs(group, [&](std::string_view key, std::span<const uint64_t> offsets) {
+          write_group(out, key, offsets);
+        });
+      }
+      for (const auto& run : runs) {
+        std::filesystem::remove(run, ec);
+      }
+      runs = std::move(merged);
+    }
+  }
+
+  void finish_in_memory(const Callback& callback) {
+    sort_pairs();
+    for_each_group([&](std::string_view key, const std::vector<uint64_t>& offsets) {
+      if (keep_keys) {
+        keys.push_back(key);
+      }
+      callback(key, offsets);
+    });
+    std::vector<Pair>().swap(pairs);
+    if (!keep_keys) {
+      std::vector<char>().swap(arena);
+    }
+  }
+
+  void finish_merged(const Callback& callback) {
+    if (!pairs.empty()) {
+      spill();
+    }
+    std::vector<Pair>().swap(pairs);
+    std::vector<char>().swap(arena);
+    reduce_runs();
+    if (!keep_keys) {
+      merge_runs(runs, callback);
+      return;
+    }
+
+    keys_path = temp_file("keys");
+    std::ofstream keys_out(keys_path, std::ios::binary);
+    keys_out.exceptions(std::ios::failbit | std::ios::badbit);
+    std::vector<uint16_t> key_lengths;
+    merge_runs(runs, [&](std::string_view key, std::span<const uint64_t> offsets) {
+      keys_out.write(key.data(), static_cast<std::streamsize>(key.size()));
+      key_lengths.push_back(static_cast<uint16_t>(key.size()));
+      callback(key, offsets);
+    });
+    keys_out.close();
+    map_keys(key_lengths);
+  }
+
+  void map_keys(const std::vector<uint16_t>& key_lengths) {
+    int fd = open(keys_path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw std::runtime_error("failed to open key list");
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw std::runtime_error("failed to open key list");
+    }
+
+    keys_size = st.st_size;
+    if (keys_size > 0) {
+      void* addr = mmap(nullptr, keys_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("failed to map key list");
+      }
+      keys_data = static_cast<char*>(addr);
+    }
+    close(fd);
+
+    keys.reserve(key_lengths.size());
+    size_t pos = 0;
+    for (uint16_t len : key_lengths) {
+      keys.emplace_back(keys_data + pos, len);
+      pos += len;
+    }
+  }
+};
+
+Builder::Builder(std::filesystem::path temp_prefix, size_t memory_budget, bool keep_keys)
+    : ptr_(std::make_unique<Impl>()) {
+  ptr_->temp_prefix = std::move(temp_prefix);
+  ptr_->memory_budget = memory_budget;
+  ptr_->keep_keys = keep_keys;
+}
+
+Builder::~Builder() = default;
+
+void Builder::add(std::string_view key, uint64_t offset) {
+  if (key.size() > MAX_KEY_SIZE) {
+    throw std::length_error("posting list key is too long");
+  }
+  auto& impl = *ptr_;
+  impl.pairs.push_back(
+      Pair{.key_pos = impl.arena.size(), .offset = offset, .key_len = static_cast<uint32_t>(key.size())});
+  impl.arena.insert(impl.arena.end(), key.begin(), key.end());
+
+  if (impl.memory_budget > 0 && impl.memory_used() >= impl.memory_budget) {
+    impl.spill();
+  }
+}
+
+bool Builder::empty() const { return ptr_->pairs.empty() && ptr_->runs.empty(); }
+
+void Builder::finish(const Callback& callback) {
+  if (ptr_->runs.empty()) {
+    ptr_->finish_in_memory(callback);
+  } else {
+    ptr_->finish_merged(callback);
+  }
+}
+
+const std::vector<std::string_view>& Builder::keys() const { return ptr_->keys; }
+}
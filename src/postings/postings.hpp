@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace postings {
+// runs and key lists store u16 key lengths
+constexpr size_t MAX_KEY_SIZE = UINT16_MAX;
+
+// collects (key, record offset) pairs and emits them grouped into posting lists in key order.
+// with a memory budget, pairs are spilled to sorted runs on disk and k-way merged in finish, in several passes
+// when there are many runs. the budget bounds the buffered pairs only, finish still keeps one view and length
+// per unique key (about 18 bytes) while the key bytes themselves are mapped from disk.
+class Builder {
+ public:
+  using Callback = std::function<void(std::string_view key, std::span<const uint64_t> offsets)>;
+
+  // runs are written next to temp_prefix, a budget of 0 keeps every pair in memory. without keep_keys, keys() stays
+  // empty, for key sets that are only consumed by the finish callback
+  Builder(std::filesystem::path temp_prefix, size_t memory_budget, bool keep_keys = true);
+  ~Builder();
+
+  Builder(const Builder&) = delete;
+  Builder& operator=(const Builder&) = delete;
+
+  // offsets of a key have to be added in ascending order. throws std::length_error for keys longer than
+  // MAX_KEY_SIZE, callers skip them before adding
+  void add(std::string_view key, uint64_t offset);
+  bool empty() const;
+
+  void finish(const Callback& callback);
+  // unique keys in the order they were passed to the callback, valid until the builder is destroyed
+  const std::vector<std::string_view>& keys() const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> ptr_;
+};
+}
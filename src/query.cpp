@@ -1,22 +1,35 @@
 #include "hoshidicts/query.hpp"
 
 #include <ankerl/unordered_dense.h>
-#include <sys/fcntl.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <unistd.h>
 #include <zstd.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <fstream>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <iterator>
+#include <memory_resource>
 #include <memory>
 #include <ranges>
+#include <span>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
 
+#include "container/container.hpp"
+#include "glossary_cache/glossary_cache.hpp"
+#include "glossary_index/glossary_index.hpp"
 #include "hash/hash.hpp"
-#include "json/yomitan_parser.hpp"
+#include "sorted_keys/sorted_keys.hpp"
+#include "thread_pool/thread_pool.hpp"
+#include "wildcard/wildcard.hpp"
 
 namespace {
 uint8_t read_u8(const uint8_t*& addr) { return *addr++; }
@@ -42,134 +55,561 @@ uint64_t read_u64(const uint8_t*& addr) {
   return result;
 }
 
+uint64_t read_varint(const uint8_t*& addr) {
+  uint64_t result = 0;
+  for (int shift = 0;; shift += 7) {
+    const uint8_t byte = *addr++;
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return result;
+    }
+  }
+}
+
 std::string_view read_str(const uint8_t*& addr, uint32_t len) {
   std::string_view result(reinterpret_cast<const char*>(addr), len);
   addr += len;
   return result;
 }
+
+std::vector<DictionaryTag> read_tags(std::span<const uint8_t> section) {
+  if (section.size() < sizeof(uint32_t)) {
+    return {};
+  }
+
+  const auto* addr = section.data();
+  uint32_t count = read_u32(addr);
+  std::vector<DictionaryTag> tags;
+  tags.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    DictionaryTag tag;
+    uint8_t name_len = read_u8(addr);
+    tag.name = read_str(addr, name_len);
+    uint8_t category_len = read_u8(addr);
+    tag.category = read_str(addr, category_len);
+    tag.order = static_cast<int32_t>(read_u32(addr));
+    uint16_t notes_len = read_u16(addr);
+    tag.notes = read_str(addr, notes_len);
+    tag.score = static_cast<int32_t>(read_u32(addr));
+    tags.push_back(std::move(tag));
+  }
+  return tags;
 }
 
-struct DictionaryQuery::DictionaryData {
+// decompression contexts are expensive to set up, every thread keeps one for all dictionaries
+ZSTD_DCtx* thread_dctx() {
+  thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+  return dctx.get();
+}
+
+void prefetch(const void* addr) { __builtin_prefetch(addr); }
+
+// calls fn(offset) for every record of a posting list, offsets are delta coded
+template <typename Fn>
+void for_each_offset(const uint8_t* list, Fn&& fn) {
+  uint64_t count = read_varint(list);
+  uint64_t offset = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    offset += read_varint(list);
+    fn(offset);
+  }
+}
+
+// adapts fn(dict, record offset) to the (dict, posting list) callbacks of the key indexes
+template <typename Fn>
+auto each_record(Fn&& fn) {
+  return [&fn](const auto& dict, const uint8_t* list) {
+    for_each_offset(list, [&](uint64_t offset) { fn(dict, offset); });
+  };
+}
+
+// keeps the offsets of result that also appear in the posting list, both are ascending
+void intersect(std::pmr::vector<uint64_t>& result, const uint8_t* list) {
+  size_t in = 0;
+  size_t out = 0;
+  for_each_offset(list, [&](uint64_t offset) {
+    while (in < result.size() && result[in] < offset) {
+      in++;
+    }
+    if (in < result.size() && result[in] == offset) {
+      result[out++] = result[in++];
+    }
+  });
+  result.resize(out);
+}
+
+// sections read by every lookup, the targets of the residency policies. the key lists are left out, only merged
+// index builds read them
+constexpr std::array TERM_INDEX_SECTIONS = {container::Section::term_phf, container::Section::term_offsets};
+constexpr std::array META_INDEX_SECTIONS = {container::Section::meta_phf, container::Section::meta_offsets};
+
+std::span<const container::Section> index_sections(bool terms) {
+  return terms ? std::span(TERM_INDEX_SECTIONS) : std::span(META_INDEX_SECTIONS);
+}
+
+void apply_residency(const container::Reader& file, std::span<const container::Section> sections,
+                     Residency residency) {
+  for (auto id : sections) {
+    switch (residency) {
+      case Residency::lazy:
+      case Residency::populate:
+        break;
+      case Residency::willneed_index:
+        file.advise(id, container::Advice::willneed);
+        break;
+      case Residency::lock_index:
+        if (!file.lock(id)) {
+          file.advise(id, container::Advice::willneed);
+        }
+        break;
+      case Residency::huge_pages:
+        // the hint has to come before the pages are faulted in
+        file.advise(id, container::Advice::hugepage);
+        file.advise(id, container::Advice::willneed);
+        break;
+    }
+  }
+}
+
+std::string_view as_string(std::span<const uint8_t> section) {
+  return {reinterpret_cast<const char*>(section.data()), section.size()};
+}
+
+// phf over the keys of one section plus the slot -> posting list table into the blobs
+struct KeyIndex {
   hash::mphf phf;
-  uint8_t* blobs = nullptr;
-  size_t blobs_size = 0;
-  uint64_t* offsets = nullptr;
-  size_t offsets_size = 0;
-  uint8_t* media = nullptr;
-  size_t media_size = 0;
-  ankerl::unordered_dense::map<std::string_view, std::pair<uint32_t, uint32_t>> media_index;
+  // resolved at load, so single key probes don't branch on the pilot width
+  hash::phf_lookup lookup = nullptr;
+  std::span<const uint64_t> offsets;
+  // u16 length + key per slot, only read to build merged indexes
+  std::span<const uint8_t> keys;
+
+  bool load(std::span<const uint8_t> phf_section, std::span<const uint8_t> offsets_section,
+            std::span<const uint8_t> keys_section) {
+    if (!phf.load(phf_section)) {
+      return false;
+    }
+    lookup = phf.lookup();
+    // sections are page aligned, so the table can be used in place
+    offsets = {reinterpret_cast<const uint64_t*>(offsets_section.data()), offsets_section.size() / sizeof(uint64_t)};
+    keys = keys_section;
+    return true;
+  }
 
-  ~DictionaryData() {
-    if (blobs) {
-      munmap(blobs, blobs_size);
+  // calls fn(key, posting list) for every slot, false if the key list doesn't match the table
+  template <typename Fn>
+  bool for_each_key(const uint8_t* blobs, Fn&& fn) const {
+    const uint8_t* addr = keys.data();
+    const uint8_t* end = addr + keys.size();
+    for (uint64_t entry : offsets) {
+      if (end - addr < static_cast<ptrdiff_t>(sizeof(uint16_t))) {
+        return false;
+      }
+      uint16_t key_len = read_u16(addr);
+      if (end - addr < key_len) {
+        return false;
+      }
+      fn(read_str(addr, key_len), blobs + (entry & hash::SLOT_OFFSET_MASK));
+    }
+    return addr == end;
+  }
+
+  // out of range if the section is missing
+  uint64_t slot(std::string_view key) const { return offsets.empty() ? UINT64_MAX : lookup(phf, key); }
+
+  void slots_of(std::span<const std::string_view> keys, std::span<uint64_t> out) const {
+    if (offsets.empty()) {
+      std::ranges::fill(out, UINT64_MAX);
+      return;
+    }
+    phf.hash_many(keys, out);
+  }
+
+  void prefetch_slot(uint64_t slot) const {
+    if (slot < offsets.size()) {
+      prefetch(&offsets[slot]);
     }
-    if (offsets) {
-      munmap(offsets, offsets_size);
+  }
+
+  // posting list of a key in slot, nullptr if the slot fingerprint rejects the key
+  const uint8_t* postings(const uint8_t* blobs, uint64_t slot, uint64_t fingerprint) const {
+    if (slot >= offsets.size()) {
+      return nullptr;
     }
-    if (media) {
-      munmap(media, media_size);
+    const uint64_t entry = offsets[slot];
+    if ((entry & ~hash::SLOT_OFFSET_MASK) != fingerprint) {
+      return nullptr;
     }
+    return blobs + (entry & hash::SLOT_OFFSET_MASK);
+  }
+
+  const uint8_t* postings(const uint8_t* blobs, std::string_view key) const {
+    return postings(blobs, slot(key), hash::slot_fingerprint(key));
   }
 };
 
-DictionaryQuery::DictionaryQuery() = default;
-DictionaryQuery::~DictionaryQuery() = default;
+TagsView read_tags_view(const uint8_t*& addr, const std::vector<DictionaryTag>& tags) {
+  uint8_t count = read_u8(addr);
+  TagsView view{.ids = addr, .count = count, .table = &tags};
+  addr += count * sizeof(uint16_t);
+  return view;
+}
+
+// smallest string greater than every string starting with prefix, empty if there is none
+std::string prefix_end(std::string_view prefix) {
+  std::string end(prefix);
+  while (!end.empty() && static_cast<uint8_t>(end.back()) == 0xff) {
+    end.pop_back();
+  }
+  if (!end.empty()) {
+    end.back() = static_cast<char>(static_cast<uint8_t>(end.back()) + 1);
+  }
+  return end;
+}
 
-DictionaryQuery::DictionaryQuery(DictionaryQuery&&) noexcept = default;
-DictionaryQuery& DictionaryQuery::operator=(DictionaryQuery&&) noexcept = default;
+// sorts matches by key and dictionary, keeping the first limit distinct keys
+template <typename T>
+void keep_first_keys(std::vector<T>& matches, size_t limit) {
+  std::ranges::sort(matches, {}, [](const T& match) { return std::tie(match.key, match.dict_index); });
+  size_t distinct = 0;
+  auto it = matches.begin();
+  for (; it != matches.end(); ++it) {
+    if (it == matches.begin() || it->key != std::prev(it)->key) {
+      if (distinct == limit) {
+        break;
+      }
+      distinct++;
+    }
+  }
+  matches.erase(it, matches.end());
+}
 
-void DictionaryQuery::add_dict(const std::string& path, DictionaryType type) {
-  if (!std::filesystem::is_regular_file(path + "/.hoshidicts_1")) {
-    return;
+template <typename T>
+std::vector<std::string> distinct_keys(std::vector<T>&& matches) {
+  std::vector<std::string> keys;
+  for (auto& match : matches) {
+    if (keys.empty() || keys.back() != match.key) {
+      keys.push_back(std::move(match.key));
+    }
   }
+  return keys;
+}
 
-  std::ifstream sui(path + "/.hoshidicts_1", std::ios::binary);
-  char hash_type;
-  sui.get(hash_type);
+std::vector<DictionaryTag> to_tags(const TagsView& view) {
+  std::vector<DictionaryTag> result;
+  result.reserve(view.count);
+  view.for_each([&](const DictionaryTag& tag) { result.push_back(tag); });
+  return result;
+}
 
-  Dictionary dict;
-  Index index;
-  std::string buf{};
-  if (glz::read_file_json(index, path + "/index.json", buf)) {
-    return;
+// consecutive views of the same dictionary form one entry
+std::vector<FrequencyEntry> to_entries(std::span<const FrequencyView> views) {
+  std::vector<FrequencyEntry> result;
+  for (size_t i = 0; i < views.size(); i++) {
+    const auto& view = views[i];
+    if (i == 0 || views[i - 1].dict_index != view.dict_index) {
+      result.push_back(FrequencyEntry{.dict_name = std::string(view.dict_name), .frequencies = {}});
+    }
+    result.back().frequencies.push_back(
+        Frequency{.value = view.value,
+                  .display_value = view.display_value.empty() ? std::to_string(view.value)
+                                                              : std::string(view.display_value)});
   }
+  return result;
+}
 
-  dict.name = index.title.empty() ? std::filesystem::path(path).stem().string() : index.title;
-  if (std::filesystem::exists(path + "/styles.css")) {
-    std::ifstream f(path + "/styles.css");
-    dict.styles = std::string(std::istreambuf_iterator<char>(f), {});
+std::vector<PitchEntry> to_entries(std::span<const PitchView> views) {
+  std::vector<PitchEntry> result;
+  for (const auto& view : views) {
+    if (result.empty() || result.back().dict_name != view.dict_name) {
+      result.push_back(PitchEntry{.dict_name = std::string(view.dict_name), .pitch_positions = {}, .pitches = {}});
+    }
+    result.back().pitch_positions.push_back(view.position);
+    result.back().pitches.push_back(PitchAccent{.position = view.position,
+                                                .nasal = {view.nasal.begin(), view.nasal.end()},
+                                                .devoice = {view.devoice.begin(), view.devoice.end()},
+                                                .tags = to_tags(view.tags)});
   }
+  return result;
+}
+}
 
-  dict.data = std::make_unique<DictionaryData>();
-  dict.data->phf.load(path + "/hash.mph", static_cast<hash::phf_type>(hash_type));
+struct DictionaryQuery::DictionaryData {
+  container::Reader file;
+  KeyIndex terms;
+  KeyIndex meta;
+  // empty for dictionaries imported without sorted keys
+  sorted_keys::Reader sorted_terms;
+  // only present if the dictionary was imported with a suffix index
+  sorted_keys::Reader term_suffixes;
+  // glossary token -> posting list, only present if the dictionary was imported with a glossary index
+  sorted_keys::Reader glossary_tokens;
+  const uint8_t* blobs = nullptr;
+  std::span<const uint8_t> media;
+  hash::mphf media_phf;
+  std::span<const uint64_t> media_index;
+  ZSTD_DDict* glossary_dict = nullptr;
+  std::vector<DictionaryTag> tags;
+
+  // drops everything queries read, for dictionaries that failed to load lazily
+  void clear() {
+    terms.offsets = {};
+    terms.keys = {};
+    meta.offsets = {};
+    meta.keys = {};
+    sorted_terms = {};
+    term_suffixes = {};
+    glossary_tokens = {};
+    media_index = {};
+  }
 
-  struct stat st{};
-  int fd = open((path + "/offsets.bin").c_str(), O_RDONLY);
-  if (fd == -1) {
-    return;
+  ~DictionaryData() {
+    if (glossary_dict) {
+      ZSTD_freeDDict(glossary_dict);
+    }
   }
+};
 
-  if (fstat(fd, &st) != 0) {
-    close(fd);
-    return;
+// one phf over the keys of several dictionaries. a slot holds the fingerprint of its key, the dictionaries containing
+// it as a bitmask and their posting lists, so a probe hashes the key once instead of once per dictionary
+struct DictionaryQuery::MergedIndex {
+  static constexpr size_t MAX_DICTS = 64;
+
+  struct Slot {
+    uint64_t fingerprint;
+    uint64_t dicts;
+    uint64_t first_postings;
+  };
+
+  hash::mphf phf;
+  hash::phf_lookup lookup = nullptr;
+  std::vector<Slot> slots;
+  std::vector<const uint8_t*> postings;
+
+  bool build(std::span<const DictionaryData* const> dicts, const KeyIndex DictionaryData::*section) {
+    if (dicts.size() < 2 || dicts.size() > MAX_DICTS) {
+      return false;
+    }
+
+    ankerl::unordered_dense::map<std::string_view, uint32_t> ids;
+    std::vector<std::string_view> keys;
+    std::vector<uint64_t> key_dicts;
+    // (key id, posting list) in dictionary order
+    std::vector<std::pair<uint32_t, const uint8_t*>> entries;
+    for (size_t i = 0; i < dicts.size(); i++) {
+      const auto& data = *dicts[i];
+      const bool valid = (data.*section).for_each_key(data.blobs, [&](std::string_view key, const uint8_t* list) {
+        auto [it, inserted] = ids.try_emplace(key, static_cast<uint32_t>(keys.size()));
+        if (inserted) {
+          keys.push_back(key);
+          key_dicts.push_back(0);
+        }
+        key_dicts[it->second] |= uint64_t{1} << i;
+        entries.emplace_back(it->second, list);
+      });
+      if (!valid) {
+        return false;
+      }
+    }
+    if (keys.empty()) {
+      return false;
+    }
+
+    phf.build(keys, std::max<size_t>(1, std::thread::hardware_concurrency()));
+    lookup = phf.lookup();
+    std::vector<uint64_t> key_slots(keys.size());
+    phf.hash_many(keys, key_slots);
+    slots.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      slots[key_slots[i]] =
+          Slot{.fingerprint = hash::slot_fingerprint(keys[i]), .dicts = key_dicts[i], .first_postings = 0};
+    }
+
+    uint64_t first_postings = 0;
+    for (auto& slot : slots) {
+      slot.first_postings = first_postings;
+      first_postings += std::popcount(slot.dicts);
+    }
+    postings.resize(first_postings);
+    std::vector<uint8_t> filled(slots.size());
+    for (const auto& [id, list] : entries) {
+      const uint64_t slot = key_slots[id];
+      postings[slots[slot].first_postings + filled[slot]++] = list;
+    }
+    return true;
   }
 
-  dict.data->offsets_size = st.st_size;
-  dict.data->offsets = reinterpret_cast<uint64_t*>(mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
-  if (dict.data->offsets == MAP_FAILED) {
-    close(fd);
-    return;
+  uint64_t slot(std::string_view key) const { return lookup(phf, key); }
+
+  void slots_of(std::span<const std::string_view> keys, std::span<uint64_t> out) const { phf.hash_many(keys, out); }
+
+  void prefetch_slot(uint64_t slot) const {
+    if (slot < slots.size()) {
+      prefetch(&slots[slot]);
+    }
   }
-  close(fd);
 
-  fd = open((path + "/blobs.bin").c_str(), O_RDONLY);
-  if (fd == -1) {
-    return;
+  template <typename Fn>
+  void find(std::string_view key, Fn&& fn) const {
+    find(slot(key), hash::slot_fingerprint(key), fn);
   }
 
-  if (fstat(fd, &st) != 0) {
-    close(fd);
-    return;
+  // calls fn(dictionary index, posting list) for the key with fingerprint in slot_index
+  template <typename Fn>
+  void find(uint64_t slot_index, uint64_t fingerprint, Fn&& fn) const {
+    if (slot_index >= slots.size()) {
+      return;
+    }
+    const Slot& slot = slots[slot_index];
+    if (slot.fingerprint != fingerprint) {
+      return;
+    }
+    const uint8_t* const* list = postings.data() + slot.first_postings;
+    for (uint64_t dicts = slot.dicts; dicts != 0; dicts &= dicts - 1) {
+      fn(static_cast<size_t>(std::countr_zero(dicts)), *list++);
+    }
   }
+};
 
-  dict.data->blobs_size = st.st_size;
-  dict.data->blobs = reinterpret_cast<uint8_t*>(mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
-  if (dict.data->blobs == MAP_FAILED) {
-    close(fd);
-    return;
+// merged indexes are built by the calls that add dictionaries or enable the index, never by queries. queries only
+// load the published pointer, kinds with lazily added dictionaries publish theirs once those are loaded
+struct DictionaryQuery::MergedIndexes {
+  bool enabled = false;
+  std::array<std::unique_ptr<MergedIndex>, 3> owned;
+  std::array<std::atomic<const MergedIndex*>, 3> current{};
+
+  void reset(DictionaryType type) {
+    current[type].store(nullptr, std::memory_order_release);
+    owned[type].reset();
   }
-  close(fd);
 
-  fd = open((path + "/media.bin").c_str(), O_RDONLY);
-  if (fd != -1) {
-    if (fstat(fd, &st) != 0) {
-      close(fd);
+  // stays null if the dictionaries can't be merged, queries then probe every dictionary
+  void rebuild(DictionaryType type, std::span<const DictionaryData* const> dicts) {
+    reset(type);
+    if (!enabled) {
       return;
     }
-    dict.data->media_size = st.st_size;
-    dict.data->media = reinterpret_cast<uint8_t*>(mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
-    if (dict.data->media == MAP_FAILED) {
-      close(fd);
-      return;
+    auto index = std::make_unique<MergedIndex>();
+    if (index->build(dicts, type == TERM ? &DictionaryData::terms : &DictionaryData::meta)) {
+      owned[type] = std::move(index);
+      current[type].store(owned[type].get(), std::memory_order_release);
     }
-    close(fd);
   }
+};
 
-  if (dict.data->media_size > 0) {
-    const uint8_t* addr = dict.data->media;
-    const uint8_t* eof = addr + dict.data->media_size;
-    while (addr < eof) {
-      uint16_t path_size = read_u16(addr);
-      std::string_view media_path = read_str(addr, path_size);
-      uint32_t media_size = read_u32(addr);
+// lazily added dictionaries are loaded in parallel by a background job started by add_dicts. queries of a kind
+// wait for the dictionaries of that kind only, calls that add dictionaries wait for the whole job
+struct DictionaryQuery::PendingLoads {
+  std::array<std::shared_future<void>, 3> ready;
+  std::future<void> job;
 
-      dict.data->media_index.emplace(
-          media_path, std::pair<uint32_t, uint32_t>{media_size, static_cast<uint32_t>(addr - dict.data->media)});
+  ~PendingLoads() { wait(); }
 
-      addr += media_size;
+  void wait() const {
+    if (job.valid()) {
+      job.wait();
     }
   }
+};
+
+struct QueryContext::Impl {
+  // arrays of one query_view call, they don't move once the call returned
+  struct Block {
+    explicit Block(std::pmr::memory_resource* resource)
+        : terms(resource), glossaries(resource), frequencies(resource), pitches(resource) {}
+
+    std::pmr::vector<TermView> terms;
+    std::pmr::vector<GlossaryView> glossaries;
+    std::pmr::vector<FrequencyView> frequencies;
+    std::pmr::vector<PitchView> pitches;
+  };
+
+  explicit Impl(std::pmr::memory_resource* resource) : resource(resource), blocks(resource), strings(resource) {}
+
+  std::pmr::memory_resource* resource;
+  std::pmr::vector<Block> blocks;
+  // merged rules, the only strings not found in the mapping
+  std::pmr::deque<std::pmr::string> strings;
+};
+
+QueryContext::QueryContext(std::pmr::memory_resource* resource) : ptr_(std::make_unique<Impl>(resource)) {}
+QueryContext::~QueryContext() = default;
+
+QueryContext::QueryContext(QueryContext&&) noexcept = default;
+QueryContext& QueryContext::operator=(QueryContext&&) noexcept = default;
 
+void QueryContext::clear() {
+  ptr_->blocks.clear();
+  ptr_->strings.clear();
+}
+
+DictionaryQuery::DictionaryQuery()
+    : pending_(std::make_unique<PendingLoads>()), merged_(std::make_unique<MergedIndexes>()) {}
+DictionaryQuery::~DictionaryQuery() {
+  if (pending_) {
+    pending_->wait();
+  }
+}
+
+DictionaryQuery::DictionaryQuery(DictionaryQuery&&) noexcept = default;
+DictionaryQuery& DictionaryQuery::operator=(DictionaryQuery&&) noexcept = default;
+
+bool DictionaryQuery::open_dict(const std::string& path, DictionaryType type, Residency residency, Dictionary& dict) {
+  dict.data = std::make_unique<DictionaryData>();
+  auto& data = *dict.data;
+  if (!data.file.open(path, residency == Residency::populate) ||
+      !data.file.has(type == TERM ? container::Section::term_phf : container::Section::meta_phf)) {
+    return false;
+  }
+
+  const auto title = as_string(data.file.section(container::Section::title));
+  dict.name = title.empty() ? std::filesystem::path(path).stem().string() : std::string(title);
+  dict.styles = as_string(data.file.section(container::Section::styles));
+  return true;
+}
+
+bool DictionaryQuery::load_dict(DictionaryData& data, DictionaryType type, Residency residency) {
+  // term dictionaries only need the term section, frequency and pitch dictionaries only the meta section
+  if (type == TERM) {
+    if (!data.terms.load(data.file.section(container::Section::term_phf),
+                         data.file.section(container::Section::term_offsets),
+                         data.file.section(container::Section::term_keys))) {
+      return false;
+    }
+    data.sorted_terms.load(data.file.section(container::Section::term_sorted_keys));
+    data.term_suffixes.load(data.file.section(container::Section::term_suffixes));
+    data.glossary_tokens.load(data.file.section(container::Section::glossary_tokens));
+  } else if (!data.meta.load(data.file.section(container::Section::meta_phf),
+                             data.file.section(container::Section::meta_offsets),
+                             data.file.section(container::Section::meta_keys))) {
+    return false;
+  }
+  data.blobs = data.file.section(container::Section::blobs).data();
+  apply_residency(data.file, index_sections(type == TERM), residency);
+
+  const auto glossary_dict = data.file.section(container::Section::glossary_dict);
+  if (!glossary_dict.empty()) {
+    data.glossary_dict = ZSTD_createDDict(glossary_dict.data(), glossary_dict.size());
+    if (!data.glossary_dict) {
+      return false;
+    }
+  }
+
+  data.tags = read_tags(data.file.section(container::Section::tags));
+
+  // media index: one media section record offset per phf slot
+  data.media = data.file.section(container::Section::media);
+  if (data.file.has(container::Section::media_phf)) {
+    if (!data.media_phf.load(data.file.section(container::Section::media_phf))) {
+      return false;
+    }
+    const auto media_index = data.file.section(container::Section::media_index);
+    data.media_index = {reinterpret_cast<const uint64_t*>(media_index.data()), media_index.size() / sizeof(uint64_t)};
+  }
+  return true;
+}
+
+void DictionaryQuery::append_dict(DictionaryType type, Dictionary&& dict) {
   switch (type) {
     case TERM:
       term_dicts_.push_back(std::move(dict));
@@ -183,221 +623,911 @@ void DictionaryQuery::add_dict(const std::string& path, DictionaryType type) {
   }
 }
 
-void DictionaryQuery::add_term_dict(const std::string& path) { add_dict(path, DictionaryQuery::DictionaryType::TERM); }
+void DictionaryQuery::add_dict(const std::string& path, DictionaryType type, Residency residency) {
+  pending_->wait();
+  Dictionary dict;
+  if (open_dict(path, type, residency, dict) && load_dict(*dict.data, type, residency)) {
+    append_dict(type, std::move(dict));
+    build_merged_index(type);
+  }
+}
+
+void DictionaryQuery::add_dicts(std::span<const DictionarySource> sources) {
+  auto type_of = [](DictionaryKind kind) {
+    switch (kind) {
+      case DictionaryKind::term:
+        return TERM;
+      case DictionaryKind::frequency:
+        return FREQ;
+      case DictionaryKind::pitch:
+        break;
+    }
+    return PITCH;
+  };
+
+  pending_->wait();
+  std::vector<Dictionary> loaded(sources.size());
+  std::vector<char> valid(sources.size());
+  {
+    const size_t hardware_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    thread_pool::Pool pool(std::min(hardware_threads, sources.size()));
+    std::vector<std::future<bool>> results;
+    results.reserve(sources.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+      results.push_back(pool.submit([&, i]() {
+        const auto& source = sources[i];
+        const DictionaryType type = type_of(source.kind);
+        if (!open_dict(source.path, type, source.residency, loaded[i])) {
+          return false;
+        }
+        if (source.lazy_load) {
+          return true;
+        }
+        return load_dict(*loaded[i].data, type, source.residency);
+      }));
+    }
+    for (size_t i = 0; i < sources.size(); i++) {
+      valid[i] = results[i].get();
+    }
+  }
 
-void DictionaryQuery::add_freq_dict(const std::string& path) { add_dict(path, DictionaryQuery::DictionaryType::FREQ); }
+  // dictionaries keep the order of sources, whichever finished loading first
+  struct LazyLoad {
+    DictionaryData* data;
+    DictionaryType type;
+    Residency residency;
+  };
+  std::vector<LazyLoad> lazy;
+  std::array<bool, 3> added{};
+  for (size_t i = 0; i < sources.size(); i++) {
+    if (valid[i]) {
+      const DictionaryType type = type_of(sources[i].kind);
+      if (sources[i].lazy_load) {
+        lazy.push_back(LazyLoad{.data = loaded[i].data.get(), .type = type, .residency = sources[i].residency});
+      }
+      append_dict(type, std::move(loaded[i]));
+      added[type] = true;
+    }
+  }
 
-void DictionaryQuery::add_pitch_dict(const std::string& path) {
-  add_dict(path, DictionaryQuery::DictionaryType::PITCH);
+  std::array<std::promise<void>, 3> loads_done;
+  std::array<std::vector<const DictionaryData*>, 3> merge_inputs;
+  for (auto type : {TERM, FREQ, PITCH}) {
+    if (!added[type]) {
+      continue;
+    }
+    const bool has_lazy = std::ranges::any_of(lazy, [type](const LazyLoad& load) { return load.type == type; });
+    if (!has_lazy) {
+      build_merged_index(type);
+      continue;
+    }
+    merged_->reset(type);
+    merge_inputs[type] = dict_data(type);
+    pending_->ready[type] = loads_done[type].get_future().share();
+  }
+  if (lazy.empty()) {
+    return;
+  }
+
+  // captures no this, the dictionary data and merged indexes stay put when the query object is moved
+  pending_->job = std::async(std::launch::async, [lazy = std::move(lazy), loads_done = std::move(loads_done),
+                                                  merge_inputs = std::move(merge_inputs),
+                                                  merged = merged_.get()]() mutable {
+    const size_t hardware_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    thread_pool::Pool pool(std::min(hardware_threads, lazy.size()));
+    std::array<std::vector<std::future<void>>, 3> results;
+    for (const auto& load : lazy) {
+      results[load.type].push_back(pool.submit([load]() {
+        // the dictionary stays registered, without an index it has no entries
+        if (!load_dict(*load.data, load.type, load.residency)) {
+          load.data->clear();
+        }
+      }));
+    }
+    for (auto type : {TERM, FREQ, PITCH}) {
+      if (results[type].empty()) {
+        continue;
+      }
+      for (auto& result : results[type]) {
+        result.get();
+      }
+      loads_done[type].set_value();
+      merged->rebuild(type, merge_inputs[type]);
+    }
+  });
 }
 
-std::vector<TermResult> DictionaryQuery::query(const std::string& expression) const {
-  std::map<std::pair<std::string_view, std::string_view>, TermResult> term_map;
-  for (const auto& [name, styles, data] : term_dicts_) {
-    uint64_t hash = data->phf(expression);
-    uint64_t offset_addr = data->offsets[hash];
-    const uint8_t* index_addr = data->blobs + offset_addr;
+void DictionaryQuery::add_term_dict(const std::string& path, Residency residency) {
+  add_dict(path, DictionaryQuery::DictionaryType::TERM, residency);
+}
 
-    uint32_t count = read_u32(index_addr);
-    for (uint32_t i = 0; i < count; i++) {
-      uint64_t offset = read_u64(index_addr);
-      const uint8_t* blob_addr = data->blobs + offset;
+void DictionaryQuery::add_freq_dict(const std::string& path, Residency residency) {
+  add_dict(path, DictionaryQuery::DictionaryType::FREQ, residency);
+}
 
-      // first byte encodes term (0) or meta (1) entry
-      uint8_t type = read_u8(blob_addr);
-      if (type != 0) {
-        continue;
+void DictionaryQuery::add_pitch_dict(const std::string& path, Residency residency) {
+  add_dict(path, DictionaryQuery::DictionaryType::PITCH, residency);
+}
+
+void DictionaryQuery::warm() const {
+  for (auto type : {TERM, FREQ, PITCH}) {
+    for (const auto& dict : dicts(type)) {
+      for (auto id : index_sections(type == TERM)) {
+        dict.data->file.touch(id);
       }
+    }
+  }
+}
 
-      uint16_t expr_len = read_u16(blob_addr);
-      std::string_view expr = read_str(blob_addr, expr_len);
+void DictionaryQuery::set_merged_index(bool enabled) {
+  pending_->wait();
+  merged_->enabled = enabled;
+  for (auto type : {TERM, FREQ, PITCH}) {
+    build_merged_index(type);
+  }
+}
 
-      uint16_t reading_len = read_u16(blob_addr);
-      std::string_view reading = read_str(blob_addr, reading_len);
+void DictionaryQuery::build_merged_index(DictionaryType type) { merged_->rebuild(type, dict_data(type)); }
+
+std::vector<const DictionaryQuery::DictionaryData*> DictionaryQuery::dict_data(DictionaryType type) const {
+  std::vector<const DictionaryData*> data;
+  for (const auto& dict : registered_dicts(type)) {
+    data.push_back(dict.data.get());
+  }
+  return data;
+}
+
+const std::vector<DictionaryQuery::Dictionary>& DictionaryQuery::dicts(DictionaryType type) const {
+  if (const auto& ready = pending_->ready[type]; ready.valid()) {
+    ready.wait();
+  }
+  return registered_dicts(type);
+}
+
+const std::vector<DictionaryQuery::Dictionary>& DictionaryQuery::registered_dicts(DictionaryType type) const {
+  switch (type) {
+    case TERM:
+      return term_dicts_;
+    case FREQ:
+      return freq_dicts_;
+    case PITCH:
+      break;
+  }
+  return pitch_dicts_;
+}
+
+const DictionaryQuery::MergedIndex* DictionaryQuery::merged_index(DictionaryType type) const {
+  return merged_->current[type].load(std::memory_order_acquire);
+}
+
+template <typename Fn>
+void DictionaryQuery::for_each_postings(DictionaryType type, std::string_view key, Fn&& fn) const {
+  const auto& type_dicts = dicts(type);
+  if (const MergedIndex* merged = merged_index(type)) {
+    merged->find(key, [&](size_t index, const uint8_t* list) { fn(type_dicts[index], list); });
+    return;
+  }
 
-      if (expr != expression && reading != expression) {
+  for (const auto& dict : type_dicts) {
+    const KeyIndex& index = type == TERM ? dict.data->terms : dict.data->meta;
+    if (const uint8_t* list = index.postings(dict.data->blobs, key)) {
+      fn(dict, list);
+    }
+  }
+}
+
+template <typename Fn>
+std::span<const TermView> DictionaryQuery::make_terms(std::string_view expression, QueryContext& context,
+                                                      Fn&& for_each_record) const {
+  auto* resource = context.ptr_->resource;
+  auto& block = context.ptr_->blocks.emplace_back(resource);
+
+  struct Match {
+    std::string_view expression;
+    std::string_view reading;
+    std::string_view rules;
+    GlossaryView glossary;
+  };
+  std::pmr::vector<Match> matches(resource);
+  for_each_record([&](const Dictionary& dict, uint64_t offset) {
+    const auto& [name, styles, data] = dict;
+    const auto dict_index = static_cast<uint32_t>(&dict - term_dicts_.data());
+    const uint8_t* blob_addr = data->blobs + offset;
+
+    uint16_t expr_len = read_u16(blob_addr);
+    std::string_view expr = read_str(blob_addr, expr_len);
+
+    uint16_t reading_len = read_u16(blob_addr);
+    std::string_view reading = read_str(blob_addr, reading_len);
+
+    if (!expression.empty() && expr != expression && reading != expression) {
+      return;
+    }
+
+    uint64_t glossary_offset = read_u64(blob_addr);
+    uint32_t glossary_size = read_u32(blob_addr);
+
+    TagsView definition_tags = read_tags_view(blob_addr, data->tags);
+
+    uint8_t rules_size = read_u8(blob_addr);
+    std::string_view rules = read_str(blob_addr, rules_size);
+
+    TagsView term_tags = read_tags_view(blob_addr, data->tags);
+
+    matches.push_back(Match{
+        .expression = expr,
+        .reading = reading,
+        .rules = rules,
+        .glossary = {.dict_name = name,
+                     .handle = {.dict_index = dict_index, .offset = glossary_offset, .size = glossary_size},
+                     .definition_tags = definition_tags,
+                     .term_tags = term_tags}});
+  });
+
+  // terms are ordered by expression and reading, their glossaries keep dictionary order
+  std::ranges::stable_sort(matches, {}, [](const Match& match) { return std::pair(match.expression, match.reading); });
+  block.glossaries.reserve(matches.size());
+  for (const auto& match : matches) {
+    block.glossaries.push_back(match.glossary);
+  }
+
+  for (size_t i = 0; i < matches.size();) {
+    size_t end = i;
+    std::string_view rules;
+    std::pmr::string* merged = nullptr;
+    for (; end < matches.size() && matches[end].expression == matches[i].expression &&
+           matches[end].reading == matches[i].reading;
+         end++) {
+      // rules of a single record are used in place, only merged rules are copied
+      std::string_view current = matches[end].rules;
+      if (current.empty()) {
+        continue;
+      }
+      if (rules.empty()) {
+        rules = current;
         continue;
       }
+      if (!merged) {
+        merged = &context.ptr_->strings.emplace_back(rules);
+      }
+      *merged += ' ';
+      *merged += current;
+      rules = *merged;
+    }
 
-      uint64_t glossary_offset = read_u64(blob_addr);
-      uint32_t glossary_size = read_u32(blob_addr);
-      std::string glossary = decompress_glossary(data->blobs + glossary_offset, glossary_size);
-
-      uint8_t def_tags_size = read_u8(blob_addr);
-      std::string_view definition_tags = read_str(blob_addr, def_tags_size);
-
-      uint8_t rules_size = read_u8(blob_addr);
-      std::string_view rules = read_str(blob_addr, rules_size);
-
-      uint8_t term_tag_size = read_u8(blob_addr);
-      std::string_view term_tags = read_str(blob_addr, term_tag_size);
-
-      GlossaryEntry entry;
-      entry.dict_name = name;
-      entry.definition_tags = definition_tags;
-      entry.term_tags = term_tags;
-      entry.glossary = glossary;
-
-      auto [it, inserted] = term_map.try_emplace({expr, reading});
-      if (inserted) {
-        it->second = {.expression = std::string(expr),
-                      .reading = std::string(reading),
-                      .rules = std::string(rules),
-                      .glossaries = {},
-                      .frequencies = {}};
-      } else {
-        if (!rules.empty()) {
-          if (!it->second.rules.empty()) {
-            it->second.rules += " ";
-          }
-          it->second.rules += rules;
+    block.terms.push_back(TermView{.expression = matches[i].expression,
+                                   .reading = matches[i].reading,
+                                   .rules = rules,
+                                   .glossaries = std::span(block.glossaries).subspan(i, end - i),
+                                   .frequencies = {},
+                                   .pitches = {}});
+    i = end;
+  }
+
+  // spans are taken once the arrays stopped growing
+  std::pmr::vector<std::pair<size_t, size_t>> meta_begin(resource);
+  meta_begin.reserve(block.terms.size());
+  for (const auto& term : block.terms) {
+    meta_begin.emplace_back(block.frequencies.size(), block.pitches.size());
+    find_frequencies(term.expression, term.reading, block.frequencies);
+    find_pitches(term.expression, term.reading, block.pitches);
+  }
+  for (size_t i = 0; i < block.terms.size(); i++) {
+    const auto [freq_begin, pitch_begin] = meta_begin[i];
+    const auto [freq_end, pitch_end] =
+        i + 1 < meta_begin.size() ? meta_begin[i + 1] : std::pair(block.frequencies.size(), block.pitches.size());
+    block.terms[i].frequencies = std::span(block.frequencies).subspan(freq_begin, freq_end - freq_begin);
+    block.terms[i].pitches = std::span(block.pitches).subspan(pitch_begin, pitch_end - pitch_begin);
+  }
+
+  return block.terms;
+}
+
+std::span<const TermView> DictionaryQuery::query_view(std::string_view expression, QueryContext& context) const {
+  return make_terms(expression, context, [&](auto&& fn) { for_each_postings(TERM, expression, each_record(fn)); });
+}
+
+std::pmr::vector<const uint8_t*> DictionaryQuery::find_postings_batch(DictionaryType type,
+                                                                    std::span<const std::string_view> keys,
+                                                                    std::pmr::memory_resource* resource) const {
+  const auto& type_dicts = dicts(type);
+  const size_t dict_count = type_dicts.size();
+  std::pmr::vector<const uint8_t*> lists(keys.size() * dict_count, nullptr, resource);
+
+  std::pmr::vector<uint64_t> fingerprints(resource);
+  fingerprints.reserve(keys.size());
+  for (auto key : keys) {
+    fingerprints.push_back(hash::slot_fingerprint(key));
+  }
+
+  // every pass only reads memory prefetched by the previous one
+  std::pmr::vector<uint64_t> slots(resource);
+  if (const MergedIndex* merged = merged_index(type)) {
+    slots.resize(keys.size());
+    merged->slots_of(keys, slots);
+    for (uint64_t slot : slots) {
+      merged->prefetch_slot(slot);
+    }
+    for (size_t k = 0; k < keys.size(); k++) {
+      merged->find(slots[k], fingerprints[k], [&](size_t index, const uint8_t* list) {
+        prefetch(list);
+        lists[k * dict_count + index] = list;
+      });
+    }
+  } else {
+    slots.resize(keys.size() * dict_count);
+    std::pmr::vector<uint64_t> dict_slots(keys.size(), resource);
+    for (size_t d = 0; d < dict_count; d++) {
+      const KeyIndex& index = type == TERM ? type_dicts[d].data->terms : type_dicts[d].data->meta;
+      index.slots_of(keys, dict_slots);
+      for (size_t k = 0; k < keys.size(); k++) {
+        slots[k * dict_count + d] = dict_slots[k];
+        index.prefetch_slot(dict_slots[k]);
+      }
+    }
+    for (size_t d = 0; d < dict_count; d++) {
+      const auto& data = *type_dicts[d].data;
+      const KeyIndex& index = type == TERM ? data.terms : data.meta;
+      for (size_t k = 0; k < keys.size(); k++) {
+        const uint8_t* list = index.postings(data.blobs, slots[k * dict_count + d], fingerprints[k]);
+        if (list) {
+          prefetch(list);
+          lists[k * dict_count + d] = list;
         }
       }
-      it->second.glossaries.push_back(std::move(entry));
     }
   }
 
-  auto results = term_map | std::views::values | std::views::as_rvalue | std::ranges::to<std::vector>();
-  query_freq(results);
-  query_pitch(results);
+  for (size_t i = 0; i < lists.size(); i++) {
+    if (!lists[i]) {
+      continue;
+    }
+    const uint8_t* blobs = type_dicts[i % dict_count].data->blobs;
+    for_each_offset(lists[i], [&](uint64_t offset) { prefetch(blobs + offset); });
+  }
+  return lists;
+}
 
+std::pmr::vector<std::span<const TermView>> DictionaryQuery::query_batch(std::span<const std::string_view> expressions,
+                                                                       QueryContext& context) const {
+  auto* resource = context.ptr_->resource;
+  const size_t dict_count = term_dicts_.size();
+  const auto lists = find_postings_batch(TERM, expressions, resource);
+
+  std::pmr::vector<std::span<const TermView>> results(resource);
+  results.reserve(expressions.size());
+  for (size_t k = 0; k < expressions.size(); k++) {
+    results.push_back(make_terms(expressions[k], context, [&](auto&& fn) {
+      for (size_t d = 0; d < dict_count; d++) {
+        if (const uint8_t* list = lists[k * dict_count + d]) {
+          each_record(fn)(term_dicts_[d], list);
+        }
+      }
+    }));
+  }
   return results;
 }
 
-void DictionaryQuery::query_freq(std::vector<TermResult>& terms) const {
-  for (auto& term : terms) {
-    for (const auto& [name, styles, data] : freq_dicts_) {
-      uint64_t hash = data->phf(term.expression);
-      uint64_t offset_addr = data->offsets[hash];
+std::vector<std::vector<TermResult>> DictionaryQuery::query_batch(std::span<const std::string_view> expressions,
+                                                                  bool materialize) const {
+  QueryContext context;
+  std::vector<std::vector<TermResult>> results;
+  results.reserve(expressions.size());
+  for (const auto& terms : query_batch(expressions, context)) {
+    results.push_back(terms |
+                      std::views::transform([&](const TermView& term) { return to_result(term, materialize); }) |
+                      std::ranges::to<std::vector>());
+  }
+  return results;
+}
 
-      const uint8_t* index_addr = data->blobs + offset_addr;
-      uint32_t count = read_u32(index_addr);
+struct DictionaryQuery::KeyPostings {
+  std::string key;
+  size_t dict_index;
+  const uint8_t* list;
+};
 
-      std::vector<Frequency> frequencies;
-      for (uint32_t i = 0; i < count; i++) {
-        uint64_t offset = read_u64(index_addr);
-        const uint8_t* blob_addr = data->blobs + offset;
+std::vector<DictionaryQuery::KeyPostings> DictionaryQuery::find_range(std::string_view first, std::string_view last,
+                                                                      size_t limit) const {
+  // every dictionary contributes at most limit keys, the merged result keeps the first limit distinct ones
+  const auto& term_dicts = dicts(TERM);
+  std::vector<KeyPostings> matches;
+  for (size_t i = 0; i < term_dicts.size(); i++) {
+    const auto& data = *term_dicts[i].data;
+    size_t count = 0;
+    data.sorted_terms.scan(first, [&](std::string_view key, uint64_t offset) {
+      if (count == limit || (!last.empty() && key >= last)) {
+        return false;
+      }
+      matches.push_back(KeyPostings{.key = std::string(key), .dict_index = i, .list = data.blobs + offset});
+      count++;
+      return true;
+    });
+  }
+  keep_first_keys(matches, limit);
+  return matches;
+}
 
-        uint8_t type = read_u8(blob_addr);
-        if (type != 1) {
-          continue;
-        }
+std::vector<DictionaryQuery::KeyPostings> DictionaryQuery::find_pattern(std::string_view pattern, size_t limit) const {
+  const size_t first_wildcard = pattern.find_first_of("*?");
+  if (first_wildcard == std::string_view::npos) {
+    // the smallest key greater than pattern is pattern followed by a zero byte
+    return find_range(pattern, std::string(pattern) + '\0', limit);
+  }
+  if (limit == 0) {
+    return {};
+  }
+  const std::string_view head = pattern.substr(0, first_wildcard);
+  const std::string_view anchor = wildcard::longest_literal(pattern);
+
+  const auto& term_dicts = dicts(TERM);
+  std::vector<KeyPostings> matches;
+  std::string key;
+  uint64_t offset = 0;
+  for (size_t i = 0; i < term_dicts.size(); i++) {
+    const auto& data = *term_dicts[i].data;
+    size_t count = 0;
+    auto add = [&](std::string_view candidate, uint64_t list_offset) {
+      if (wildcard::match(pattern, candidate)) {
+        matches.push_back(
+            KeyPostings{.key = std::string(candidate), .dict_index = i, .list = data.blobs + list_offset});
+        count++;
+      }
+      return count < limit;
+    };
+
+    if (data.term_suffixes.empty() || head.size() >= anchor.size()) {
+      // the leading literal bounds the scan, without one every key is visited
+      data.sorted_terms.scan(head, [&](std::string_view candidate, uint64_t list_offset) {
+        return candidate.starts_with(head) && add(candidate, list_offset);
+      });
+      continue;
+    }
 
-        uint16_t expr_len = read_u16(blob_addr);
-        std::string_view expr = read_str(blob_addr, expr_len);
-        if (expr != term.expression) {
-          continue;
-        }
+    // every key containing the anchor has a suffix starting with it, keys containing it twice are seen twice
+    ankerl::unordered_dense::set<uint64_t> seen;
+    data.term_suffixes.scan(anchor, [&](std::string_view suffix, uint64_t index) {
+      if (!suffix.starts_with(anchor)) {
+        return false;
+      }
+      if (!seen.insert(index).second) {
+        return true;
+      }
+      return !data.sorted_terms.at(index, key, offset) || add(key, offset);
+    });
+  }
+  keep_first_keys(matches, limit);
+  return matches;
+}
 
-        uint8_t mode_len = read_u8(blob_addr);
-        std::string_view mode = read_str(blob_addr, mode_len);
-        if (mode != "freq") {
-          continue;
-        }
+std::pmr::vector<std::span<const TermView>> DictionaryQuery::key_terms(const std::vector<KeyPostings>& matches,
+                                                                     QueryContext& context) const {
+  // posting lists come from the sorted keys, no key is hashed
+  std::pmr::vector<std::span<const TermView>> results(context.ptr_->resource);
+  for (size_t i = 0; i < matches.size();) {
+    size_t end = i;
+    while (end < matches.size() && matches[end].key == matches[i].key) {
+      end++;
+    }
+    results.push_back(make_terms(matches[i].key, context, [&](auto&& fn) {
+      for (size_t j = i; j < end; j++) {
+        each_record(fn)(term_dicts_[matches[j].dict_index], matches[j].list);
+      }
+    }));
+    i = end;
+  }
+  return results;
+}
 
-        uint32_t freq_data_size = read_u32(blob_addr);
-        std::string_view freq_data = read_str(blob_addr, freq_data_size);
+std::vector<std::string> DictionaryQuery::prefix_query(std::string_view prefix, size_t limit) const {
+  return range_query(prefix, prefix_end(prefix), limit);
+}
 
-        ParsedFrequency parsed;
-        if (yomitan_parser::parse_frequency(freq_data, parsed)) {
-          if (!parsed.reading.empty() && parsed.reading != term.reading) {
-            continue;
-          }
-          frequencies.emplace_back(
-              Frequency{.value = parsed.value, .display_value = std::string(parsed.display_value)});
+std::vector<std::string> DictionaryQuery::range_query(std::string_view first, std::string_view last,
+                                                      size_t limit) const {
+  return distinct_keys(find_range(first, last, limit));
+}
+
+std::vector<std::string> DictionaryQuery::wildcard_query(std::string_view pattern, size_t limit) const {
+  return distinct_keys(find_pattern(pattern, limit));
+}
+
+std::pmr::vector<std::span<const TermView>> DictionaryQuery::prefix_query(std::string_view prefix, size_t limit,
+                                                                        QueryContext& context) const {
+  return range_query(prefix, prefix_end(prefix), limit, context);
+}
+
+std::pmr::vector<std::span<const TermView>> DictionaryQuery::range_query(std::string_view first,
+                                                                       std::string_view last, size_t limit,
+                                                                       QueryContext& context) const {
+  return key_terms(find_range(first, last, limit), context);
+}
+
+std::pmr::vector<std::span<const TermView>> DictionaryQuery::wildcard_query(std::string_view pattern, size_t limit,
+                                                                          QueryContext& context) const {
+  return key_terms(find_pattern(pattern, limit), context);
+}
+
+std::span<const TermView> DictionaryQuery::search_glossary(std::string_view query, size_t limit,
+                                                           QueryContext& context) const {
+  auto* resource = context.ptr_->resource;
+  std::vector<std::string> tokens = glossary_index::tokenize(query);
+  std::ranges::sort(tokens);
+  tokens.erase(std::ranges::unique(tokens).begin(), tokens.end());
+  if (tokens.empty() || limit == 0) {
+    return {};
+  }
+
+  struct Hit {
+    size_t dict_index;
+    uint64_t offset;
+    std::string_view expression;
+    std::string_view reading;
+  };
+  std::pmr::vector<Hit> hits(resource);
+  std::pmr::vector<const uint8_t*> lists(resource);
+  std::pmr::vector<uint64_t> offsets(resource);
+  const auto& term_dicts = dicts(TERM);
+  for (size_t i = 0; i < term_dicts.size(); i++) {
+    const auto& data = *term_dicts[i].data;
+    if (data.glossary_tokens.empty()) {
+      continue;
+    }
+
+    lists.clear();
+    for (const auto& token : tokens) {
+      data.glossary_tokens.scan(token, [&](std::string_view key, uint64_t list_offset) {
+        if (key == token) {
+          lists.push_back(data.blobs + list_offset);
         }
-      }
-      if (!frequencies.empty()) {
-        term.frequencies.emplace_back(FrequencyEntry{.dict_name = name, .frequencies = std::move(frequencies)});
+        return false;
+      });
+    }
+    if (lists.size() != tokens.size()) {
+      continue;
+    }
+
+    // the shortest list bounds the result, every other list only filters it
+    std::ranges::sort(lists, {}, [](const uint8_t* list) { return read_varint(list); });
+    offsets.clear();
+    for_each_offset(lists.front(), [&](uint64_t offset) { offsets.push_back(offset); });
+    for (size_t j = 1; j < lists.size() && !offsets.empty(); j++) {
+      intersect(offsets, lists[j]);
+    }
+
+    for (uint64_t offset : offsets) {
+      const uint8_t* blob_addr = data.blobs + offset;
+      uint16_t expr_len = read_u16(blob_addr);
+      std::string_view expr = read_str(blob_addr, expr_len);
+      uint16_t reading_len = read_u16(blob_addr);
+      hits.push_back(
+          Hit{.dict_index = i, .offset = offset, .expression = expr, .reading = read_str(blob_addr, reading_len)});
+    }
+  }
+
+  // every matching term is ranked without decoding its frequency records, a heap keeps the best limit terms and only
+  // those are decoded and get their pitches. the stable sort keeps dictionary order within a term
+  auto key = [](const Hit& hit) { return std::pair(hit.expression, hit.reading); };
+  std::ranges::stable_sort(hits, {}, key);
+  struct RankedTerm {
+    std::pair<size_t, int32_t> rank;
+    size_t begin;
+    size_t end;
+  };
+  // ties are broken by key like the final order, the heap top is the worst kept term
+  auto by_rank = [](const RankedTerm& term) { return std::pair(term.rank, term.begin); };
+  std::pmr::vector<RankedTerm> ranked(resource);
+  for (size_t i = 0; i < hits.size();) {
+    size_t end = i;
+    while (end < hits.size() && key(hits[end]) == key(hits[i])) {
+      end++;
+    }
+    const RankedTerm term{.rank = frequency_rank(hits[i].expression, hits[i].reading), .begin = i, .end = end};
+    i = end;
+    if (ranked.size() < limit) {
+      ranked.push_back(term);
+      std::ranges::push_heap(ranked, {}, by_rank);
+    } else if (by_rank(term) < by_rank(ranked.front())) {
+      std::ranges::pop_heap(ranked, {}, by_rank);
+      ranked.back() = term;
+      std::ranges::push_heap(ranked, {}, by_rank);
+    }
+  }
+  std::ranges::sort(ranked, {}, [](const RankedTerm& term) { return term.begin; });
+
+  auto terms = make_terms({}, context, [&](auto&& fn) {
+    for (const auto& term : ranked) {
+      for (size_t i = term.begin; i < term.end; i++) {
+        fn(term_dicts_[hits[i].dict_index], hits[i].offset);
       }
     }
+  });
+  // make_terms orders by key, which stays the tie breaker
+  auto& block_terms = context.ptr_->blocks.back().terms;
+  std::ranges::stable_sort(block_terms, {}, [&](const TermView& term) { return frequency_rank(term.frequencies); });
+  return terms;
+}
+
+std::vector<TermResult> DictionaryQuery::search_glossary(std::string_view query, size_t limit,
+                                                         bool materialize) const {
+  QueryContext context;
+  return search_glossary(query, limit, context) |
+         std::views::transform([&](const TermView& term) { return to_result(term, materialize); }) |
+         std::ranges::to<std::vector>();
+}
+
+std::vector<TermResult> DictionaryQuery::query(const std::string& expression, bool materialize) const {
+  QueryContext context;
+  return query_view(expression, context) |
+         std::views::transform([&](const TermView& term) { return to_result(term, materialize); }) |
+         std::ranges::to<std::vector>();
+}
+
+TermResult DictionaryQuery::to_result(const TermView& view, bool materialize) const {
+  TermResult result{.expression = std::string(view.expression),
+                    .reading = std::string(view.reading),
+                    .rules = std::string(view.rules),
+                    .glossaries = {},
+                    .frequencies = to_entries(view.frequencies),
+                    .pitches = to_entries(view.pitches)};
+  result.glossaries.reserve(view.glossaries.size());
+  for (const auto& glossary : view.glossaries) {
+    GlossaryEntry entry{.dict_name = std::string(glossary.dict_name),
+                        .glossary = {},
+                        .definition_tags = to_tags(glossary.definition_tags),
+                        .term_tags = to_tags(glossary.term_tags),
+                        .handle = glossary.handle};
+    if (materialize) {
+      get_glossary(entry.handle, entry.glossary);
+    }
+    result.glossaries.push_back(std::move(entry));
+  }
+  return result;
+}
+
+void DictionaryQuery::materialize(GlossaryEntry& entry) const {
+  if (entry.glossary.empty()) {
+    get_glossary(entry.handle, entry.glossary);
+  }
+}
+
+void DictionaryQuery::materialize(TermResult& term) const {
+  for (auto& entry : term.glossaries) {
+    materialize(entry);
+  }
+}
+
+void DictionaryQuery::query_freq(std::vector<TermResult>& terms) const {
+  std::pmr::vector<FrequencyView> views;
+  for (auto& term : terms) {
+    views.clear();
+    find_frequencies(term.expression, term.reading, views);
+    std::ranges::move(to_entries(views), std::back_inserter(term.frequencies));
   }
 }
 
 void DictionaryQuery::query_pitch(std::vector<TermResult>& terms) const {
+  std::pmr::vector<PitchView> views;
   for (auto& term : terms) {
-    for (const auto& [name, styles, data] : pitch_dicts_) {
-      uint64_t hash = data->phf(term.expression);
-      uint64_t offset_addr = data->offsets[hash];
+    views.clear();
+    find_pitches(term.expression, term.reading, views);
+    std::ranges::move(to_entries(views), std::back_inserter(term.pitches));
+  }
+}
 
-      const uint8_t* index_addr = data->blobs + offset_addr;
-      uint32_t count = read_u32(index_addr);
+template <typename Fn>
+void DictionaryQuery::for_each_frequency(std::string_view expression, std::string_view reading, Fn&& fn) const {
+  for_each_postings(FREQ, expression, [&](const Dictionary& dict, const uint8_t* index_addr) {
+    const auto& data = dict.data;
 
-      std::vector<int> pitch_positions;
-      for (uint32_t i = 0; i < count; i++) {
-        uint64_t offset = read_u64(index_addr);
-        const uint8_t* blob_addr = data->blobs + offset;
+    uint64_t count = read_varint(index_addr);
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < count; i++) {
+      offset += read_varint(index_addr);
+      const uint8_t* blob_addr = data->blobs + offset;
 
-        uint8_t type = read_u8(blob_addr);
-        if (type != 1) {
-          continue;
-        }
+      uint16_t expr_len = read_u16(blob_addr);
+      std::string_view expr = read_str(blob_addr, expr_len);
+      if (expr != expression) {
+        continue;
+      }
 
-        uint16_t expr_len = read_u16(blob_addr);
-        std::string_view expr = read_str(blob_addr, expr_len);
-        if (expr != term.expression) {
-          continue;
-        }
+      // mode byte encodes frequency (0) or pitch (1) data
+      uint8_t mode = read_u8(blob_addr);
+      if (mode != 0) {
+        continue;
+      }
 
-        uint8_t mode_len = read_u8(blob_addr);
-        std::string_view mode = read_str(blob_addr, mode_len);
-        if (mode != "pitch") {
-          continue;
-        }
+      uint16_t reading_len = read_u16(blob_addr);
+      std::string_view meta_reading = read_str(blob_addr, reading_len);
+      if (!meta_reading.empty() && meta_reading != reading) {
+        continue;
+      }
+
+      fn(dict, static_cast<int32_t>(read_u32(blob_addr)), blob_addr);
+    }
+  });
+}
 
-        uint32_t pitch_data_size = read_u32(blob_addr);
-        std::string_view pitch_data = read_str(blob_addr, pitch_data_size);
+void DictionaryQuery::find_frequencies(std::string_view expression, std::string_view reading,
+                                       std::pmr::vector<FrequencyView>& out) const {
+  for_each_frequency(expression, reading, [&](const Dictionary& dict, int32_t value, const uint8_t* blob_addr) {
+    uint16_t display_len = read_u16(blob_addr);
+    out.push_back(FrequencyView{.dict_name = dict.name,
+                                .dict_index = static_cast<uint32_t>(&dict - freq_dicts_.data()),
+                                .value = value,
+                                .display_value = read_str(blob_addr, display_len)});
+  });
+}
 
-        ParsedPitch parsed;
-        if (yomitan_parser::parse_pitch(pitch_data, parsed)) {
-          if (!parsed.reading.empty() && parsed.reading != term.reading) {
-            continue;
-          }
-          pitch_positions.insert(pitch_positions.end(), parsed.pitches.begin(), parsed.pitches.end());
-        }
+std::pair<size_t, int32_t> DictionaryQuery::frequency_rank(std::span<const FrequencyView> frequencies) const {
+  // frequencies are grouped by dictionary in the order they were added. negative values are unknown frequencies,
+  // lookup ignores them as well
+  const FrequencyView* first = nullptr;
+  int32_t value = INT32_MAX;
+  for (const auto& frequency : frequencies) {
+    if (frequency.value < 0) {
+      continue;
+    }
+    if (!first) {
+      first = &frequency;
+    } else if (frequency.dict_index != first->dict_index) {
+      break;
+    }
+    value = std::min(value, frequency.value);
+  }
+  if (!first) {
+    return {freq_dicts_.size(), INT32_MAX};
+  }
+  return {first->dict_index, value};
+}
+
+std::pair<size_t, int32_t> DictionaryQuery::frequency_rank(std::string_view expression,
+                                                           std::string_view reading) const {
+  std::pair<size_t, int32_t> rank{freq_dicts_.size(), INT32_MAX};
+  for_each_frequency(expression, reading, [&](const Dictionary& dict, int32_t value, const uint8_t*) {
+    if (value >= 0) {
+      rank = std::min(rank, std::pair(static_cast<size_t>(&dict - freq_dicts_.data()), value));
+    }
+  });
+  return rank;
+}
+
+void DictionaryQuery::find_pitches(std::string_view expression, std::string_view reading,
+                                   std::pmr::vector<PitchView>& out) const {
+  for_each_postings(PITCH, expression, [&](const Dictionary& dict, const uint8_t* index_addr) {
+    const auto& [name, styles, data] = dict;
+
+    uint64_t count = read_varint(index_addr);
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < count; i++) {
+      offset += read_varint(index_addr);
+      const uint8_t* blob_addr = data->blobs + offset;
+
+      uint16_t expr_len = read_u16(blob_addr);
+      std::string_view expr = read_str(blob_addr, expr_len);
+      if (expr != expression) {
+        continue;
+      }
+
+      uint8_t mode = read_u8(blob_addr);
+      if (mode != 1) {
+        continue;
+      }
+
+      uint16_t reading_len = read_u16(blob_addr);
+      std::string_view meta_reading = read_str(blob_addr, reading_len);
+      if (!meta_reading.empty() && meta_reading != reading) {
+        continue;
       }
-      if (!pitch_positions.empty()) {
-        term.pitches.emplace_back(PitchEntry{.dict_name = name, .pitch_positions = std::move(pitch_positions)});
+
+      uint8_t pitch_count = read_u8(blob_addr);
+      for (uint8_t j = 0; j < pitch_count; j++) {
+        auto position = static_cast<int32_t>(read_u32(blob_addr));
+        uint8_t nasal_count = read_u8(blob_addr);
+        std::span<const uint8_t> nasal(blob_addr, nasal_count);
+        blob_addr += nasal_count;
+        uint8_t devoice_count = read_u8(blob_addr);
+        std::span<const uint8_t> devoice(blob_addr, devoice_count);
+        blob_addr += devoice_count;
+        out.push_back(PitchView{.dict_name = name,
+                                .position = position,
+                                .nasal = nasal,
+                                .devoice = devoice,
+                                .tags = read_tags_view(blob_addr, data->tags)});
       }
     }
+  });
+}
+
+void DictionaryQuery::set_glossary_cache(size_t byte_budget) {
+  glossary_cache_ = byte_budget > 0 ? std::make_unique<GlossaryCache>(byte_budget) : nullptr;
+}
+
+GlossaryCacheStats DictionaryQuery::get_glossary_cache_stats() const {
+  if (!glossary_cache_) {
+    return {};
+  }
+  const auto stats = glossary_cache_->stats();
+  return {.hits = stats.hits, .misses = stats.misses, .size_bytes = stats.size_bytes, .entries = stats.entries};
+}
+
+bool DictionaryQuery::get_glossary(const GlossaryHandle& handle, std::string& out) const {
+  const auto& term_dicts = dicts(TERM);
+  if (handle.dict_index >= term_dicts.size()) {
+    return false;
+  }
+  const auto& data = *term_dicts[handle.dict_index].data;
+  if (!glossary_cache_) {
+    return decompress_glossary(data, handle.offset, handle.size, out);
+  }
+
+  // glossaries are deduplicated at import, so one entry serves every record sharing the offset
+  const uint64_t key = (uint64_t{handle.dict_index} << hash::SLOT_OFFSET_BITS) | handle.offset;
+  if (glossary_cache_->get(key, out)) {
+    return true;
+  }
+  if (!decompress_glossary(data, handle.offset, handle.size, out)) {
+    return false;
   }
+  glossary_cache_->put(key, out);
+  return true;
 }
 
-std::string DictionaryQuery::decompress_glossary(const void* data, size_t size) {
-  if (!data || size == 0) {
-    return "";
+bool DictionaryQuery::decompress_glossary(const DictionaryData& dict, uint64_t offset, uint32_t size,
+                                          std::string& out) {
+  out.clear();
+  if (size == 0) {
+    return true;
   }
 
+  const void* data = dict.blobs + offset;
   unsigned long long decompressed_size = ZSTD_getFrameContentSize(data, size);
   if (decompressed_size == ZSTD_CONTENTSIZE_ERROR || decompressed_size == ZSTD_CONTENTSIZE_UNKNOWN) {
-    return "";
+    return false;
   }
 
-  std::string result;
-  result.resize(decompressed_size);
-
-  size_t actual_size = ZSTD_decompress(result.data(), result.size(), data, size);
-  if (ZSTD_isError(actual_size)) {
-    return "";
+  ZSTD_DCtx* dctx = thread_dctx();
+  if (!dctx) {
+    return false;
   }
 
-  result.resize(actual_size);
-  return result;
+  // decompresses straight into out, its capacity is reused across calls
+  bool ok = false;
+  out.resize_and_overwrite(decompressed_size, [&](char* buf, size_t n) -> size_t {
+    const size_t actual_size = dict.glossary_dict
+                                   ? ZSTD_decompress_usingDDict(dctx, buf, n, data, size, dict.glossary_dict)
+                                   : ZSTD_decompressDCtx(dctx, buf, n, data, size);
+    ok = !ZSTD_isError(actual_size);
+    return ok ? actual_size : 0;
+  });
+  return ok;
 }
 
 std::vector<char> DictionaryQuery::get_media_file(const std::string& dict_name, const std::string& media_path) const {
-  for (const auto& [name, styles, data] : term_dicts_) {
+  for (const auto& [name, styles, data] : dicts(TERM)) {
     if (name != dict_name) {
       continue;
     }
 
-    auto it = data->media_index.find(media_path);
-    if (it == data->media_index.end()) {
+    if (data->media_index.empty() || data->media.empty()) {
+      return {};
+    }
+
+    const uint64_t slot = data->media_phf(media_path);
+    if (slot >= data->media_index.size()) {
+      return {};
+    }
+
+    // the phf maps unknown paths to arbitrary slots, so the stored path has to match
+    const uint8_t* addr = data->media.data() + data->media_index[slot];
+    uint16_t path_size = read_u16(addr);
+    if (read_str(addr, path_size) != media_path) {
       return {};
     }
 
-    const auto [size, offset] = it->second;
-    const char* media_data = reinterpret_cast<const char*>(data->media + offset);
+    uint32_t size = read_u32(addr);
+    const char* media_data = reinterpret_cast<const char*>(addr);
     return {media_data, media_data + size};
   }
   return {};
@@ -409,6 +1539,15 @@ std::vector<DictionaryStyle> DictionaryQuery::get_styles() const {
          std::ranges::to<std::vector>();
 }
 
+std::vector<DictionaryTag> DictionaryQuery::get_tags(const std::string& dict_name) const {
+  for (const auto& [name, styles, data] : dicts(TERM)) {
+    if (name == dict_name) {
+      return data->tags;
+    }
+  }
+  return {};
+}
+
 std::vector<std::string> DictionaryQuery::get_freq_dict_order() const {
   return freq_dicts_ | std::views::transform([](const auto& d) { return d.name; }) | std::ranges::to<std::vector>();
 }
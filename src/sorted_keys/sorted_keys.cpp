@@ -0,0 +1,181 @@
+#include "sorted_keys.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace {
+// bucket size trades decoding work per lookup against the size of the head table
+constexpr uint64_t BUCKET_SIZE = 16;
+// the buckets come first so they can be streamed, followed by a u64 offset per bucket relative to the first one and a
+// trailer of u64 key count and u64 bucket count
+constexpr size_t TRAILER_SIZE = 16;
+constexpr size_t FLUSH_SIZE = 1 << 16;
+
+void write_u64(std::vector<char>& buf, uint64_t val) {
+  const auto* data = reinterpret_cast<const char*>(&val);
+  buf.insert(buf.end(), data, data + sizeof(val));
+}
+
+void write_varint(std::vector<char>& buf, uint64_t val) {
+  while (val >= 0x80) {
+    buf.push_back(static_cast<char>((val & 0x7f) | 0x80));
+    val >>= 7;
+  }
+  buf.push_back(static_cast<char>(val));
+}
+
+void write_str(std::vector<char>& buf, std::string_view str) { buf.insert(buf.end(), str.begin(), str.end()); }
+
+uint64_t read_u64(const uint8_t* addr) {
+  uint64_t val;
+  std::memcpy(&val, addr, sizeof(val));
+  return val;
+}
+
+uint64_t read_varint(const uint8_t*& addr) {
+  uint64_t val = 0;
+  for (int shift = 0;; shift += 7) {
+    const uint8_t byte = *addr++;
+    val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return val;
+    }
+  }
+}
+}
+
+namespace sorted_keys {
+void Writer::add(std::string_view key, uint64_t value) {
+  if (key_count_ % BUCKET_SIZE == 0) {
+    bucket_offsets_.push_back(written_ + buf_.size());
+    write_varint(buf_, key.size());
+    write_str(buf_, key);
+  } else {
+    const std::string_view previous = previous_;
+    const auto [shared, _] = std::ranges::mismatch(previous, key);
+    const auto prefix_len = static_cast<uint64_t>(shared - previous.begin());
+    write_varint(buf_, prefix_len);
+    write_varint(buf_, key.size() - prefix_len);
+    write_str(buf_, key.substr(prefix_len));
+  }
+  write_varint(buf_, value);
+  previous_ = key;
+  key_count_++;
+  if (buf_.size() >= FLUSH_SIZE) {
+    flush();
+  }
+}
+
+void Writer::finish() {
+  for (uint64_t offset : bucket_offsets_) {
+    write_u64(buf_, offset);
+  }
+  write_u64(buf_, key_count_);
+  write_u64(buf_, bucket_offsets_.size());
+  flush();
+}
+
+void Writer::flush() {
+  out_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+  written_ += buf_.size();
+  buf_.clear();
+}
+
+void write(std::span<const std::string_view> keys, std::span<const uint64_t> values, std::vector<char>& out) {
+  std::ostringstream stream;
+  Writer writer(stream);
+  for (size_t i = 0; i < keys.size(); i++) {
+    writer.add(keys[i], values[i]);
+  }
+  writer.finish();
+  const std::string_view data = stream.view();
+  out.insert(out.end(), data.begin(), data.end());
+}
+
+bool Reader::load(std::span<const uint8_t> data) {
+  if (data.size() < TRAILER_SIZE) {
+    return false;
+  }
+  const uint8_t* trailer = data.data() + data.size() - TRAILER_SIZE;
+  key_count_ = read_u64(trailer);
+  bucket_count_ = read_u64(trailer + 8);
+  if (bucket_count_ != (key_count_ + BUCKET_SIZE - 1) / BUCKET_SIZE ||
+      bucket_count_ > (data.size() - TRAILER_SIZE) / sizeof(uint64_t)) {
+    key_count_ = 0;
+    return false;
+  }
+  buckets_ = data.data();
+  bucket_offsets_ = trailer - bucket_count_ * sizeof(uint64_t);
+  end_ = bucket_offsets_;
+  return true;
+}
+
+std::string_view Reader::bucket_head(uint64_t bucket) const {
+  const uint8_t* addr = buckets_ + read_u64(bucket_offsets_ + bucket * sizeof(uint64_t));
+  const uint64_t len = read_varint(addr);
+  return {reinterpret_cast<const char*>(addr), len};
+}
+
+template <typename Fn>
+void Reader::decode(uint64_t bucket, uint64_t count, Fn&& fn) const {
+  std::string key;
+  const uint8_t* addr = buckets_ + read_u64(bucket_offsets_ + bucket * sizeof(uint64_t));
+  for (uint64_t i = 0; i < count && addr < end_; i++) {
+    if (i % BUCKET_SIZE == 0) {
+      const uint64_t len = read_varint(addr);
+      key.assign(reinterpret_cast<const char*>(addr), len);
+      addr += len;
+    } else {
+      const uint64_t prefix_len = read_varint(addr);
+      const uint64_t suffix_len = read_varint(addr);
+      key.resize(std::min<uint64_t>(prefix_len, key.size()));
+      key.append(reinterpret_cast<const char*>(addr), suffix_len);
+      addr += suffix_len;
+    }
+    if (!fn(std::string_view(key), read_varint(addr))) {
+      return;
+    }
+  }
+}
+
+void Reader::scan(std::string_view first, const Callback& callback) const {
+  if (key_count_ == 0) {
+    return;
+  }
+
+  // last bucket whose head is < first, equal keys may start in the bucket before the first head equal to first
+  uint64_t low = 0;
+  uint64_t high = bucket_count_;
+  while (high - low > 1) {
+    const uint64_t mid = low + (high - low) / 2;
+    if (bucket_head(mid) < first) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  decode(low, key_count_ - low * BUCKET_SIZE,
+         [&](std::string_view key, uint64_t value) { return key < first || callback(key, value); });
+}
+
+bool Reader::at(uint64_t index, std::string& key, uint64_t& value) const {
+  if (index >= key_count_) {
+    return false;
+  }
+  uint64_t remaining = index % BUCKET_SIZE;
+  bool found = false;
+  decode(index / BUCKET_SIZE, remaining + 1, [&](std::string_view current, uint64_t current_value) {
+    if (remaining-- > 0) {
+      return true;
+    }
+    key = current;
+    value = current_value;
+    found = true;
+    return false;
+  });
+  return found;
+}
+}
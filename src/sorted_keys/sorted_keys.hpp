@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// front coded sorted key array. keys are grouped into buckets, the first key of a bucket is stored in full and the
+// others as shared prefix length + suffix, so lookups binary search the bucket heads and decode a single bucket.
+namespace sorted_keys {
+// every key carries a value, the importer stores the offset of its posting list
+using Callback = std::function<bool(std::string_view key, uint64_t value)>;
+
+// streams a key array to out as keys are added, only the bucket offsets (half a byte per key) and the previous key
+// stay in memory. keys have to be added in sorted order, equal keys are stored once per value
+class Writer {
+ public:
+  explicit Writer(std::ostream& out) : out_(out) {}
+
+  void add(std::string_view key, uint64_t value);
+  // writes the bucket offsets and counts after the buckets
+  void finish();
+
+ private:
+  void flush();
+
+  std::ostream& out_;
+  std::vector<char> buf_;
+  std::vector<uint64_t> bucket_offsets_;
+  std::string previous_;
+  uint64_t key_count_ = 0;
+  uint64_t written_ = 0;
+};
+
+// whole key array at once, keys have to be sorted
+void write(std::span<const std::string_view> keys, std::span<const uint64_t> values, std::vector<char>& out);
+
+class Reader {
+ public:
+  bool load(std::span<const uint8_t> data);
+  bool empty() const { return key_count_ == 0; }
+  uint64_t size() const { return key_count_; }
+  // calls callback for keys >= first in order until it returns false
+  void scan(std::string_view first, const Callback& callback) const;
+  // key and value at a position in key order, decodes at most one bucket
+  bool at(uint64_t index, std::string& key, uint64_t& value) const;
+
+ private:
+  std::string_view bucket_head(uint64_t bucket) const;
+  // calls fn(key, value) for up to count keys starting at a bucket until it returns false
+  template <typename Fn>
+  void decode(uint64_t bucket, uint64_t count, Fn&& fn) const;
+
+  uint64_t key_count_ = 0;
+  uint64_t bucket_count_ = 0;
+  const uint8_t* bucket_offsets_ = nullptr;
+  const uint8_t* buckets_ = nullptr;
+  const uint8_t* end_ = nullptr;
+};
+}
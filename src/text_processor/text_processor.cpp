@@ -3,8 +3,8 @@
 #include <utf8.h>
 
 #include <functional>
+#include <iterator>
 #include <map>
-#include <ranges>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -12,7 +12,8 @@
 namespace {
 struct TextProcessor {
   std::vector<int> options;
-  std::function<std::u32string(const std::u32string&, int)> process;
+  // results are allocated from the resource of the input
+  std::function<std::pmr::u32string(const std::pmr::u32string&, int)> process;
 };
 
 // https://github.com/yomidevs/yomitan/blob/81d17d877fb18c62ba826210bf6db2b7f4d4deed/ext/js/language/ja/japanese.js#L21
@@ -75,8 +76,9 @@ char32_t get_prolonged_hiragana(char32_t prev) {
 bool is_in_range(uint32_t c, uint32_t range_start, uint32_t range_end) { return c >= range_start && c <= range_end; }
 
 // https://github.com/yomidevs/yomitan/blob/81d17d877fb18c62ba826210bf6db2b7f4d4deed/ext/js/language/ja/japanese.js#L472
-std::u32string hiragana_to_katakana(const std::u32string& text) {
-  std::u32string result;
+std::pmr::u32string hiragana_to_katakana(const std::pmr::u32string& text) {
+  std::pmr::u32string result(text.get_allocator());
+  result.reserve(text.size());
   const uint32_t offset = (KATAKANA_CONVERSION_RANGE_START - HIRAGANA_CONVERSION_RANGE_START);
   for (char32_t c : text) {
     if (is_in_range(c, HIRAGANA_CONVERSION_RANGE_START, HIRAGANA_CONVERSION_RANGE_END)) {
@@ -88,8 +90,9 @@ std::u32string hiragana_to_katakana(const std::u32string& text) {
 }
 
 // https://github.com/yomidevs/yomitan/blob/81d17d877fb18c62ba826210bf6db2b7f4d4deed/ext/js/language/ja/japanese.js#L441
-std::u32string katakana_to_hiragana(const std::u32string& text) {
-  std::u32string result;
+std::pmr::u32string katakana_to_hiragana(const std::pmr::u32string& text) {
+  std::pmr::u32string result(text.get_allocator());
+  result.reserve(text.size());
   const uint32_t offset = (HIRAGANA_CONVERSION_RANGE_START - KATAKANA_CONVERSION_RANGE_START);
   for (char32_t c : text) {
     switch (c) {
@@ -116,36 +119,39 @@ std::u32string katakana_to_hiragana(const std::u32string& text) {
 }
 
 // TODO: implement rest of preprocessors
-std::vector<TextProcessor> get_japanese_processors() {
-  return {
+const std::vector<TextProcessor>& get_japanese_processors() {
+  static const std::vector<TextProcessor> PROCESSORS{
       // https://github.com/yomidevs/yomitan/blob/81d17d877fb18c62ba826210bf6db2b7f4d4deed/ext/js/language/ja/japanese-text-preprocessors.js#L66
-      {.options = {0, 1, 2}, .process = [](const std::u32string& text, int opt) -> std::u32string {
+      {.options = {0, 1, 2}, .process = [](const std::pmr::u32string& text, int opt) -> std::pmr::u32string {
          switch (opt) {
            case 1:
              return katakana_to_hiragana(text);
            case 2:
              return hiragana_to_katakana(text);
            default:
-             return text;
+             return {text, text.get_allocator()};
          }
        }}};
+  return PROCESSORS;
 }
 }
 
 // https://github.com/yomidevs/yomitan/blob/81d17d877fb18c62ba826210bf6db2b7f4d4deed/ext/js/language/translator.js#L564
-std::vector<TextVariant> text_processor::process(const std::string& src) {
-  std::u32string text = utf8::utf8to32(src);
-  std::map<std::u32string, int> variants = {{text, 0}};
+std::pmr::vector<TextVariant> text_processor::process(std::string_view src, std::pmr::memory_resource* resource) {
+  std::pmr::u32string text(resource);
+  utf8::utf8to32(src.begin(), src.end(), std::back_inserter(text));
+  std::pmr::map<std::pmr::u32string, int> variants(resource);
+  variants.try_emplace(text, 0);
 
   for (const auto& processor : get_japanese_processors()) {
-    std::map<std::u32string, int> next;
+    std::pmr::map<std::pmr::u32string, int> next(resource);
 
     for (const auto& [variant, steps] : variants) {
       for (int option : processor.options) {
         auto processed = processor.process(variant, option);
         int new_steps = (processed == variant) ? steps : steps + 1;
 
-        auto [it, inserted] = next.try_emplace(processed, new_steps);
+        auto [it, inserted] = next.try_emplace(std::move(processed), new_steps);
         if (!inserted && new_steps < it->second) {
           it->second = new_steps;
         }
@@ -154,7 +160,11 @@ std::vector<TextVariant> text_processor::process(const std::string& src) {
     variants = std::move(next);
   }
 
-  return variants |
-         std::views::transform([](const auto& v) { return TextVariant{utf8::utf32to8(v.first), v.second}; }) |
-         std::ranges::to<std::vector>();
+  std::pmr::vector<TextVariant> result(resource);
+  result.reserve(variants.size());
+  for (const auto& [variant, steps] : variants) {
+    TextVariant& out = result.emplace_back(TextVariant{.text = std::pmr::string(resource), .steps = steps});
+    utf8::utf32to8(variant.begin(), variant.end(), std::back_inserter(out.text));
+  }
+  return result;
 }
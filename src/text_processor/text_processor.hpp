@@ -1,13 +1,16 @@
 #pragma once
 
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct TextVariant {
-  std::string text;
+  std::pmr::string text;
   int steps;
 };
 
 namespace text_processor {
-std::vector<TextVariant> process(const std::string& src);
+std::pmr::vector<TextVariant> process(std::string_view src,
+                                      std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 }
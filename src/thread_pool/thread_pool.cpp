@@ -0,0 +1,140 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace thread_pool {
+namespace {
+struct WorkerSlot {
+  const Pool* pool = nullptr;
+  size_t index = 0;
+};
+
+thread_local WorkerSlot current_worker;
+// id of the task running on this thread, 0 outside of tasks
+thread_local uint64_t current_task = 0;
+}
+
+Pool::Pool(size_t num_threads) {
+  num_threads = std::max<size_t>(1, num_threads);
+  for (size_t i = 0; i < num_threads; i++) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  threads_.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; i++) {
+    threads_.emplace_back([this, i]() { worker(i); });
+  }
+}
+
+Pool::~Pool() {
+  {
+    std::scoped_lock lock(wake_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void Pool::push(std::function<void()> fn) {
+  const size_t index = current_worker.pool == this ? current_worker.index : next_queue_++ % queues_.size();
+  {
+    // counted before the task is visible, so pop can never take pending_ below zero
+    std::scoped_lock lock(wake_mutex_);
+    pending_++;
+  }
+  {
+    std::scoped_lock lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(Task{.fn = std::move(fn), .id = next_id_++, .parent = current_task});
+  }
+  wake_.notify_one();
+}
+
+bool Pool::pop(size_t index, Task& task) {
+  {
+    auto& own = *queues_[index];
+    std::scoped_lock lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      pending_--;
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < queues_.size(); i++) {
+    auto& other = *queues_[(index + i) % queues_.size()];
+    std::scoped_lock lock(other.mutex);
+    if (!other.tasks.empty()) {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      pending_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+// newest child first in the own deque like pop, oldest first when taking it back from another worker
+bool Pool::pop_child(size_t index, uint64_t parent, Task& task) {
+  for (size_t i = 0; i < queues_.size(); i++) {
+    auto& queue = *queues_[(index + i) % queues_.size()];
+    std::scoped_lock lock(queue.mutex);
+    auto& tasks = queue.tasks;
+    auto is_child = [parent](const Task& queued) { return queued.parent == parent; };
+    auto it = tasks.end();
+    if (i == 0) {
+      auto newest = std::find_if(tasks.rbegin(), tasks.rend(), is_child);
+      it = newest == tasks.rend() ? tasks.end() : std::prev(newest.base());
+    } else {
+      it = std::find_if(tasks.begin(), tasks.end(), is_child);
+    }
+    if (it != tasks.end()) {
+      task = std::move(*it);
+      tasks.erase(it);
+      pending_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Pool::run_child() {
+  if (current_task == 0) {
+    return false;
+  }
+  const size_t index = current_worker.pool == this ? current_worker.index : 0;
+  Task task;
+  if (!pop_child(index, current_task, task)) {
+    return false;
+  }
+  run(task);
+  return true;
+}
+
+void Pool::run(Task& task) {
+  const uint64_t parent = std::exchange(current_task, task.id);
+  task.fn();
+  current_task = parent;
+}
+
+void Pool::worker(size_t index) {
+  current_worker = {.pool = this, .index = index};
+  Task task;
+  while (true) {
+    if (pop(index, task)) {
+      run(task);
+      task = {};
+      continue;
+    }
+
+    std::unique_lock lock(wake_mutex_);
+    wake_.wait(lock, [this]() { return stop_ || pending_ > 0; });
+    if (stop_ && pending_ == 0) {
+      return;
+    }
+  }
+}
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace thread_pool {
+// work-stealing pool: every worker owns a deque, pops its own newest task and steals the oldest task of
+// other workers when idle. tasks submitted from a worker go to that worker's deque and remember the task that
+// submitted them.
+class Pool {
+ public:
+  explicit Pool(size_t num_threads);
+  ~Pool();
+
+  Pool(const Pool&) = delete;
+  Pool& operator=(const Pool&) = delete;
+
+  template <typename Fn>
+  std::future<std::invoke_result_t<Fn>> submit(Fn&& fn) {
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Fn>()>>(std::forward<Fn>(fn));
+    auto future = task->get_future();
+    push([task]() { (*task)(); });
+    return future;
+  }
+
+  // waits for a future of a task submitted by the calling task. meanwhile the caller only runs queued tasks that
+  // it submitted itself, once none are left the rest are running on other threads and it blocks
+  template <typename T>
+  T await(std::future<T>& future) {
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready && run_child()) {
+    }
+    return future.get();
+  }
+
+  size_t size() const { return threads_.size(); }
+
+ private:
+  struct Task {
+    std::function<void()> fn;
+    uint64_t id = 0;
+    // the task that submitted this one, 0 for tasks submitted from outside the pool
+    uint64_t parent = 0;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void push(std::function<void()> fn);
+  bool pop(size_t index, Task& task);
+  bool pop_child(size_t index, uint64_t parent, Task& task);
+  bool run_child();
+  void run(Task& task);
+  void worker(size_t index);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  std::atomic<size_t> pending_ = 0;
+  std::atomic<size_t> next_queue_ = 0;
+  std::atomic<uint64_t> next_id_ = 1;
+  bool stop_ = false;
+};
+}
@@ -0,0 +1,60 @@
+#include "wildcard.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wildcard {
+bool match(std::string_view pattern, std::string_view key) {
+  auto code_point_size = [&](size_t pos) {
+    size_t size = 1;
+    while (pos + size < key.size() && (static_cast<uint8_t>(key[pos + size]) & 0xc0) == 0x80) {
+      size++;
+    }
+    return size;
+  };
+
+  size_t p = 0;
+  size_t k = 0;
+  size_t star = std::string_view::npos;
+  size_t star_k = 0;
+  while (k < key.size()) {
+    if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      star_k = k;
+    } else if (p < pattern.size() && pattern[p] == '?') {
+      p++;
+      k += code_point_size(k);
+    } else if (p < pattern.size() && pattern[p] == key[k]) {
+      p++;
+      k++;
+    } else if (star != std::string_view::npos) {
+      // let the last star consume one more code point
+      p = star + 1;
+      star_k += code_point_size(star_k);
+      k = star_k;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*') {
+    p++;
+  }
+  return p == pattern.size();
+}
+
+std::string_view longest_literal(std::string_view pattern) {
+  std::string_view longest;
+  size_t start = 0;
+  while (start <= pattern.size()) {
+    size_t end = pattern.find_first_of("*?", start);
+    if (end == std::string_view::npos) {
+      end = pattern.size();
+    }
+    if (end - start > longest.size()) {
+      longest = pattern.substr(start, end - start);
+    }
+    start = end + 1;
+  }
+  return longest;
+}
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <string_view>
+
+// wildcard patterns of DictionaryQuery::wildcard_query, * matches any sequence of code points and ? a single one
+namespace wildcard {
+bool match(std::string_view pattern, std::string_view key);
+// longest run of the pattern without wildcards, the scan anchor of suffix index lookups
+std::string_view longest_literal(std::string_view pattern);
+}
@@ -0,0 +1,284 @@
+#include "archive/archive.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "check.hpp"
+
+namespace {
+constexpr uint16_t STORED = 0;
+constexpr uint16_t DEFLATED = 8;
+
+// scratch directory for zip files and extracted dictionaries, removed with everything in it
+struct TempDir {
+  std::filesystem::path path;
+
+  TempDir() : path(std::filesystem::temp_directory_path() / "hoshidicts_archive_test") {
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+};
+
+void write_file(const std::filesystem::path& path, std::string_view content) {
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream(path, std::ios::binary).write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+  for (size_t i = 0; i < sizeof(T); i++) {
+    out.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (i * 8)));
+  }
+}
+
+// raw deflate stream holding data in a single final stored block
+std::string stored_block(std::string_view data) {
+  std::string out(1, '\x01');
+  put<uint16_t>(out, data.size());
+  put<uint16_t>(out, ~data.size());
+  return out.append(data);
+}
+
+struct ZipFile {
+  std::string name;
+  std::string data;
+  uint16_t method = STORED;
+  uint64_t size = 0;
+};
+
+ZipFile stored(std::string name, std::string data) {
+  const uint64_t size = data.size();
+  return {.name = std::move(name), .data = std::move(data), .method = STORED, .size = size};
+}
+
+ZipFile deflated(std::string name, std::string_view data) {
+  return {.name = std::move(name), .data = stored_block(data), .method = DEFLATED, .size = data.size()};
+}
+
+// writes files the way zip tools do, with zip64 records every size and offset goes through the zip64 extra field
+// and the zip64 end of central directory record. the crc is left out since the reader doesn't check it
+std::string build_zip(const std::vector<ZipFile>& files, bool zip64) {
+  const uint32_t overflow = zip64 ? UINT32_MAX : 0;
+  std::string out;
+  std::string central;
+  for (const auto& file : files) {
+    const uint64_t offset = out.size();
+    // the local extra field differs from the central one, the reader has to skip it by its own length
+    const std::string local_extra(zip64 ? 20 : 0, '\0');
+    put<uint32_t>(out, 0x04034b50);
+    put<uint16_t>(out, 45);
+    put<uint16_t>(out, 0);
+    put<uint16_t>(out, file.method);
+    put<uint32_t>(out, 0);
+    put<uint32_t>(out, 0);
+    put<uint32_t>(out, overflow | file.data.size());
+    put<uint32_t>(out, overflow | file.size);
+    put<uint16_t>(out, file.name.size());
+    put<uint16_t>(out, local_extra.size());
+    out += file.name + local_extra + file.data;
+
+    // an unrelated extra field in front of the zip64 one
+    std::string extra;
+    put<uint16_t>(extra, 0x5455);
+    put<uint16_t>(extra, 5);
+    extra.append(5, '\0');
+    if (zip64) {
+      put<uint16_t>(extra, 0x0001);
+      put<uint16_t>(extra, 24);
+      put<uint64_t>(extra, file.size);
+      put<uint64_t>(extra, file.data.size());
+      put<uint64_t>(extra, offset);
+    }
+    const std::string comment = "entry comment";
+    put<uint32_t>(central, 0x02014b50);
+    put<uint16_t>(central, 45);
+    put<uint16_t>(central, 45);
+    put<uint16_t>(central, 0);
+    put<uint16_t>(central, file.method);
+    put<uint32_t>(central, 0);
+    put<uint32_t>(central, 0);
+    put<uint32_t>(central, overflow | file.data.size());
+    put<uint32_t>(central, overflow | file.size);
+    put<uint16_t>(central, file.name.size());
+    put<uint16_t>(central, extra.size());
+    put<uint16_t>(central, comment.size());
+    put<uint16_t>(central, 0);
+    put<uint16_t>(central, 0);
+    put<uint32_t>(central, 0);
+    put<uint32_t>(central, overflow | offset);
+    central += file.name + extra + comment;
+  }
+
+  const uint64_t cd_offset = out.size();
+  out += central;
+  if (zip64) {
+    const uint64_t zip64_eocd = out.size();
+    put<uint32_t>(out, 0x06064b50);
+    put<uint64_t>(out, 44);
+    put<uint16_t>(out, 45);
+    put<uint16_t>(out, 45);
+    put<uint32_t>(out, 0);
+    put<uint32_t>(out, 0);
+    put<uint64_t>(out, files.size());
+    put<uint64_t>(out, files.size());
+    put<uint64_t>(out, central.size());
+    put<uint64_t>(out, cd_offset);
+    put<uint32_t>(out, 0x07064b50);
+    put<uint32_t>(out, 0);
+    put<uint64_t>(out, zip64_eocd);
+    put<uint32_t>(out, 1);
+  }
+  const std::string comment = "archive comment";
+  put<uint32_t>(out, 0x06054b50);
+  put<uint16_t>(out, 0);
+  put<uint16_t>(out, 0);
+  put<uint16_t>(out, zip64 ? UINT16_MAX : files.size());
+  put<uint16_t>(out, zip64 ? UINT16_MAX : files.size());
+  put<uint32_t>(out, overflow | central.size());
+  put<uint32_t>(out, overflow | cd_offset);
+  put<uint16_t>(out, comment.size());
+  return out + comment;
+}
+
+std::vector<std::string> names(const archive::Reader& reader) {
+  std::vector<std::string> out;
+  for (const auto& entry : reader.entries()) {
+    out.push_back(entry.name);
+  }
+  return out;
+}
+
+// stored and deflated entries of a zip with and without zip64 records, directory entries are left out
+void test_zip() {
+  TempDir dir;
+  const std::vector<ZipFile> files = {
+      stored("index.json", R"({"title":"test"})"),
+      stored("banks/", ""),
+      deflated("banks/term_bank_1.json", R"([["a","",null,"",0,["b"],1,""]])"),
+      stored("empty.json", ""),
+      deflated("large.bin", std::string(60000, 'x')),
+  };
+  for (bool zip64 : {false, true}) {
+    const auto path = dir.path / (zip64 ? "zip64.zip" : "zip.zip");
+    write_file(path, build_zip(files, zip64));
+    archive::Reader reader;
+    CHECK(reader.open(path.string()));
+    CHECK(names(reader) ==
+          (std::vector<std::string>{"index.json", "banks/term_bank_1.json", "empty.json", "large.bin"}));
+    CHECK(reader.entries().size() == 4 && reader.entries()[3].size == 60000);
+
+    std::string out = "previous content";
+    CHECK(reader.read(0, out) && out == R"({"title":"test"})");
+    CHECK(reader.read(1, out) && out == R"([["a","",null,"",0,["b"],1,""]])");
+    CHECK(reader.read(2, out) && out.empty());
+    CHECK(reader.read(3, out) && out == std::string(60000, 'x'));
+    CHECK(reader.read("index.json", out) && out == R"({"title":"test"})");
+    CHECK(!reader.read("banks/", out));
+    CHECK(!reader.read("missing.json", out));
+    CHECK(!reader.read(4, out));
+  }
+}
+
+// entries that fail to inflate or point outside the file are read errors, the other entries stay readable
+void test_zip_read_errors() {
+  TempDir dir;
+  ZipFile reserved_block{.name = "reserved_block", .data = "\x07\x00", .method = DEFLATED, .size = 4};
+  ZipFile short_stream = deflated("short_stream", "abc");
+  short_stream.size = 5;
+  ZipFile long_stream = deflated("long_stream", "abcdef");
+  long_stream.size = 3;
+  ZipFile truncated_stream = deflated("truncated_stream", "abcdef");
+  truncated_stream.data.resize(6);
+  ZipFile stored_size = stored("stored_size", "abc");
+  stored_size.size = 4;
+  ZipFile unsupported = stored("unsupported", "abc");
+  unsupported.method = 12;
+  const std::vector<ZipFile> files = {reserved_block, short_stream, long_stream,         truncated_stream,
+                                      stored_size,    unsupported,  stored("ok", "fine")};
+  const auto path = dir.path / "errors.zip";
+  write_file(path, build_zip(files, false));
+  archive::Reader reader;
+  CHECK(reader.open(path.string()));
+  CHECK(reader.entries().size() == files.size());
+  std::string out;
+  bool failed = true;
+  for (size_t i = 0; i + 1 < files.size(); i++) {
+    failed = failed && !reader.read(i, out);
+  }
+  CHECK(failed);
+  CHECK(reader.read("ok", out) && out == "fine");
+
+  // compressed size in the central directory running past the end of the file
+  std::string zip = build_zip({stored("index.json", "0123456789")}, false);
+  zip[zip.find("PK\x01\x02") + 22] = 1;
+  write_file(path, zip);
+  CHECK(reader.open(path.string()));
+  CHECK(!reader.read(0, out));
+}
+
+// files without a valid central directory aren't opened
+void test_zip_rejects_invalid_files() {
+  TempDir dir;
+  const auto path = dir.path / "invalid.zip";
+  archive::Reader reader;
+  CHECK(!reader.open((dir.path / "missing.zip").string()));
+  write_file(path, "");
+  CHECK(!reader.open(path.string()));
+  write_file(path, std::string(100, 'x'));
+  CHECK(!reader.open(path.string()));
+
+  const std::string zip = build_zip({stored("index.json", "{}")}, false);
+  write_file(path, zip.substr(10));
+  CHECK(!reader.open(path.string()));
+
+  // the zip64 locator points past the end of the file
+  std::string zip64 = build_zip({stored("index.json", "{}")}, true);
+  const size_t locator = zip64.size() - std::string_view("archive comment").size() - 22 - 20;
+  zip64[locator + 15] = 1;
+  write_file(path, zip64);
+  CHECK(!reader.open(path.string()));
+  CHECK(reader.entries().empty());
+}
+
+// extracted dictionaries are read from their files, with names relative to the directory
+void test_directory() {
+  TempDir dir;
+  const auto root = dir.path / "extracted";
+  write_file(root / "index.json", R"({"title":"test"})");
+  write_file(root / "banks" / "term_bank_1.json", "[]");
+  write_file(root / "empty.json", "");
+  std::filesystem::create_directories(root / "nothing");
+
+  archive::Reader reader;
+  CHECK(reader.open(root.string()));
+  std::vector<std::string> found = names(reader);
+  std::ranges::sort(found);
+  CHECK(found == (std::vector<std::string>{"banks/term_bank_1.json", "empty.json", "index.json"}));
+  std::string out = "previous content";
+  CHECK(reader.read("banks/term_bank_1.json", out) && out == "[]");
+  CHECK(reader.read("empty.json", out) && out.empty());
+  CHECK(reader.read("index.json", out) && out == R"({"title":"test"})");
+  CHECK(!reader.read("nothing", out));
+
+  // files removed after opening are read errors
+  std::filesystem::remove(root / "index.json");
+  CHECK(!reader.read("index.json", out));
+}
+}
+
+int main() {
+  test_zip();
+  test_zip_read_errors();
+  test_zip_rejects_invalid_files();
+  test_directory();
+  return check_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdio>
+
+// assertions of the test executables, a failed check is reported and fails the test without stopping it
+inline int check_failures = 0;
+
+#define CHECK(expr)                                                                 \
+  do {                                                                              \
+    if (!(expr)) {                                                                  \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+      check_failures++;                                                             \
+    }                                                                               \
+  } while (0)
@@ -0,0 +1,246 @@
+#include "container/container.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "check.hpp"
+
+namespace {
+constexpr size_t ALIGNMENT = 4096;
+constexpr size_t HEADER_SIZE = 32;
+constexpr size_t SECTION_ENTRY_SIZE = 24;
+
+// scratch directory for written containers, removed with everything in it
+struct TempDir {
+  std::filesystem::path path;
+
+  TempDir() : path(std::filesystem::temp_directory_path() / "hoshidicts_container_test") {
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+};
+
+std::string read_file(const std::filesystem::path& path) {
+  std::ifstream in(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(in), {}};
+}
+
+void write_file(const std::filesystem::path& path, std::string_view content) {
+  std::ofstream(path, std::ios::binary).write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+std::string_view as_string(std::span<const uint8_t> section) {
+  return {reinterpret_cast<const char*>(section.data()), section.size()};
+}
+
+template <typename T>
+T load(const std::string& data, size_t pos) {
+  T result;
+  std::memcpy(&result, data.data() + pos, sizeof(T));
+  return result;
+}
+
+template <typename T>
+void store(std::string& data, size_t pos, T value) {
+  std::memcpy(data.data() + pos, &value, sizeof(T));
+}
+
+std::string pattern(size_t size, char seed) {
+  std::string out(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    out[i] = static_cast<char>(seed + i * 31);
+  }
+  return out;
+}
+
+// sections written through each writer entry point, read back in place from page aligned offsets
+void test_sections() {
+  TempDir dir;
+  const auto path = (dir.path / "test.hoshidict").string();
+  const std::string title = "title";
+  const std::string blobs = pattern(ALIGNMENT * 3 + 1, 'b');
+  const std::string glossary = pattern(200000, 'g');
+  const std::string phf = pattern(ALIGNMENT, 'p');
+  {
+    container::Writer writer(path);
+    writer.add(container::Section::title, title);
+    writer.begin(container::Section::blobs) << blobs;
+    writer.end();
+    writer.add(container::Section::styles, std::span<const char>());
+    std::istringstream glossary_stream(glossary);
+    writer.add(container::Section::glossary_dict, glossary_stream);
+    writer.add(container::Section::term_phf, phf);
+    writer.finish();
+  }
+
+  container::Reader reader;
+  CHECK(reader.open(path));
+  const auto file = reader.data();
+  CHECK(file.size() == std::filesystem::file_size(path));
+  CHECK(as_string(file.first(8)) == "HOSHIDCT");
+
+  struct Expected {
+    container::Section id;
+    std::string_view content;
+  };
+  const std::vector<Expected> expected = {
+      {container::Section::title, title},
+      {container::Section::blobs, blobs},
+      {container::Section::styles, ""},
+      {container::Section::glossary_dict, glossary},
+      {container::Section::term_phf, phf},
+  };
+  bool contents = true;
+  bool aligned = true;
+  bool ordered = true;
+  const uint8_t* previous_end = file.data() + HEADER_SIZE;
+  for (const auto& section : expected) {
+    const auto data = reader.section(section.id);
+    contents = contents && reader.has(section.id) && as_string(data) == section.content;
+    aligned = aligned && static_cast<size_t>(data.data() - file.data()) % ALIGNMENT == 0;
+    ordered = ordered && data.data() >= previous_end;
+    previous_end = data.data() + data.size();
+  }
+  CHECK(contents);
+  CHECK(aligned);
+  CHECK(ordered);
+  // the section table follows the last section on its own page
+  const std::string raw = read_file(path);
+  CHECK(load<uint32_t>(raw, 8) == container::VERSION);
+  CHECK(load<uint32_t>(raw, 12) == expected.size());
+  const uint64_t table_offset = load<uint64_t>(raw, 16);
+  CHECK(table_offset % ALIGNMENT == 0 && table_offset >= static_cast<size_t>(previous_end - file.data()));
+  CHECK(table_offset + expected.size() * SECTION_ENTRY_SIZE == raw.size());
+  CHECK(load<uint64_t>(raw, 24) == raw.size());
+
+  CHECK(!reader.has(container::Section::media));
+  CHECK(reader.section(container::Section::media).empty());
+  CHECK(reader.advise(container::Section::blobs, container::Advice::willneed));
+  CHECK(reader.advise(container::Section::media, container::Advice::willneed));
+  reader.touch(container::Section::glossary_dict);
+  reader.touch(container::Section::styles);
+}
+
+// a file without sections is still valid
+void test_empty() {
+  TempDir dir;
+  const auto path = (dir.path / "empty.hoshidict").string();
+  container::Writer(path).finish();
+  container::Reader reader;
+  CHECK(reader.open(path));
+  CHECK(!reader.has(container::Section::title));
+  CHECK(reader.data().size() == ALIGNMENT);
+}
+
+void test_writer_errors() {
+  TempDir dir;
+  container::Writer writer((dir.path / "errors.hoshidict").string());
+  writer.begin(container::Section::title);
+  bool nested = false;
+  try {
+    writer.begin(container::Section::index);
+  } catch (const std::runtime_error&) {
+    nested = true;
+  }
+  CHECK(nested);
+  bool unfinished = false;
+  try {
+    writer.finish();
+  } catch (const std::runtime_error&) {
+    unfinished = true;
+  }
+  CHECK(unfinished);
+  writer.end();
+  writer.finish();
+
+  bool unopened = false;
+  try {
+    container::Writer((dir.path / "missing" / "file.hoshidict").string());
+  } catch (const std::ios::failure&) {
+    unopened = true;
+  }
+  CHECK(unopened);
+}
+
+// interrupted imports, truncated files, other versions and corrupt section tables aren't opened
+void test_rejects_invalid_files() {
+  TempDir dir;
+  const auto path = (dir.path / "valid.hoshidict").string();
+  {
+    container::Writer writer(path);
+    writer.add(container::Section::title, std::string_view("title"));
+    writer.add(container::Section::blobs, pattern(5000, 'b'));
+    writer.finish();
+  }
+  const std::string valid = read_file(path);
+  const auto corrupt_path = (dir.path / "corrupt.hoshidict").string();
+  container::Reader reader;
+  auto opens = [&](const std::string& data) {
+    write_file(corrupt_path, data);
+    return reader.open(corrupt_path);
+  };
+  CHECK(opens(valid));
+
+  CHECK(!reader.open((dir.path / "missing.hoshidict").string()));
+  CHECK(!opens(""));
+  CHECK(!opens(valid.substr(0, HEADER_SIZE - 1)));
+  CHECK(!opens(valid.substr(0, valid.size() - 1)));
+  CHECK(!opens(valid + '\0'));
+  {
+    // destroyed without finish, the header is still the placeholder
+    container::Writer writer(corrupt_path);
+    writer.add(container::Section::title, std::string_view("title"));
+  }
+  CHECK(!reader.open(corrupt_path));
+
+  std::string changed = valid;
+  changed[0] = 'h';
+  CHECK(!opens(changed));
+  changed = valid;
+  store<uint32_t>(changed, 8, container::VERSION + 1);
+  CHECK(!opens(changed));
+  changed = valid;
+  store<uint32_t>(changed, 8, container::VERSION - 1);
+  CHECK(!opens(changed));
+  changed = valid;
+  store<uint32_t>(changed, 12, 3);
+  CHECK(!opens(changed));
+  changed = valid;
+  store<uint64_t>(changed, 16, valid.size() + 1);
+  CHECK(!opens(changed));
+
+  // section entries: u32 id, u32 reserved, u64 offset, u64 size
+  const uint64_t blobs_entry = load<uint64_t>(valid, 16) + SECTION_ENTRY_SIZE;
+  changed = valid;
+  store<uint64_t>(changed, blobs_entry + 8, valid.size() + 1);
+  CHECK(!opens(changed));
+  changed = valid;
+  store<uint64_t>(changed, blobs_entry + 16, valid.size());
+  CHECK(!opens(changed));
+  changed = valid;
+  store<uint64_t>(changed, blobs_entry + 16, UINT64_MAX);
+  CHECK(!opens(changed));
+  CHECK(opens(valid));
+}
+}
+
+int main() {
+  test_sections();
+  test_empty();
+  test_writer_errors();
+  test_rejects_invalid_files();
+  return check_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+#include "glossary_index/glossary_index.hpp"
+
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+
+namespace {
+using Tokens = std::vector<std::string>;
+
+void test_tokenize() {
+  CHECK(glossary_index::tokenize("") == Tokens{});
+  CHECK(glossary_index::tokenize("To  EAT!") == (Tokens{"to", "eat"}));
+  // order and repeats are kept, the query side dedupes
+  CHECK(glossary_index::tokenize("a b a") == (Tokens{"a", "b", "a"}));
+  CHECK(glossary_index::tokenize("rice-cooker 2nd") == (Tokens{"rice", "cooker", "2nd"}));
+  // non-ascii bytes separate tokens
+  CHECK(glossary_index::tokenize("café食べるeat") == (Tokens{"caf", "eat"}));
+}
+
+void test_plain_glossaries() {
+  CHECK(glossary_index::tokenize_glossary("[]") == Tokens{});
+  CHECK(glossary_index::tokenize_glossary(R"(["to eat","Food Apple"])") == (Tokens{"apple", "eat", "food", "to"}));
+  // every token is returned once
+  CHECK(glossary_index::tokenize_glossary(R"(["eat","to eat","EAT"])") == (Tokens{"eat", "to"}));
+  // numbers, booleans and null are not text
+  CHECK(glossary_index::tokenize_glossary(R"([1, true, null, "x"])") == (Tokens{"x"}));
+}
+
+void test_structured_content() {
+  const std::string json = R"([{"type":"structured-content","content":[)"
+                           R"({"tag":"span","style":{"fontSize":"small"},"content":"Rice, cooked"},)"
+                           R"({"tag":"a","href":"?query=link","content":["link Text"]},)"
+                           R"({"tag":"img","path":"img/foo.png","title":"Picture"}]},)"
+                           R"({"type":"text","text":"drink"},{"type":"image","path":"img/bar.png"}])";
+  // tags, styles, links, paths and titles are attribute values, not text
+  CHECK(glossary_index::tokenize_glossary(json) == (Tokens{"cooked", "drink", "link", "rice", "text"}));
+}
+
+void test_nested_keys() {
+  // array elements inherit the key of their array, nested objects start with their own members
+  CHECK(glossary_index::tokenize_glossary(R"([{"content":[["deep"],{"data":{"content":"inner"}}]}])") ==
+        (Tokens{"deep", "inner"}));
+  CHECK(glossary_index::tokenize_glossary(R"([{"data":["skipped"],"content":"kept"}])") == (Tokens{"kept"}));
+  // a key named like a text key inside a skipped value is still a member key, not text
+  CHECK(glossary_index::tokenize_glossary(R"([{"href":"content","content":"x"}])") == (Tokens{"x"}));
+}
+
+void test_escapes() {
+  CHECK(glossary_index::tokenize_glossary(R"(["say \"hi\" now"])") == (Tokens{"hi", "now", "say"}));
+  CHECK(glossary_index::tokenize_glossary(R"(["a\/b"])") == (Tokens{"a", "b"}));
+  CHECK(glossary_index::tokenize_glossary(R"(["line\nbreak\ttab"])") == (Tokens{"break", "line", "tab"}));
+  CHECK(glossary_index::tokenize_glossary(R"(["ABC"])") == (Tokens{"abc"}));
+  CHECK(glossary_index::tokenize_glossary(R"(["cafés"])") == (Tokens{"caf", "s"}));
+  // escaped quotes in member keys don't end the key early
+  CHECK(glossary_index::tokenize_glossary(R"([{"a\"b":"skipped","content":"kept"}])") == (Tokens{"kept"}));
+}
+
+// malformed json must not read out of bounds or throw, whatever tokens it yields
+void test_malformed() {
+  for (const char* json : {"", "[", "]", "}", "[\"", "[\"abc", "[\"abc\\", "[\"\\u00", "[{\"", "[{\"content",
+                           "[{\"content\":", "]]]}}}[\"x\"]", "[{\"content\":\"x\"}]]]", "\"\\u12"}) {
+    glossary_index::tokenize_glossary(json);
+  }
+  CHECK(glossary_index::tokenize_glossary("[\"abc") == (Tokens{"abc"}));
+  CHECK(glossary_index::tokenize_glossary("]]]}}}[\"x\"]") == (Tokens{"x"}));
+}
+}
+
+int main() {
+  test_tokenize();
+  test_plain_glossaries();
+  test_structured_content();
+  test_nested_keys();
+  test_escapes();
+  test_malformed();
+  return check_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include "hash/hash.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "check.hpp"
+
+// probes point into the phf's own storage, so copies are rejected and moves keep the storage
+static_assert(!std::is_copy_constructible_v<hash::mphf> && !std::is_copy_assignable_v<hash::mphf>);
+
+namespace {
+// serialized phf in 8 byte aligned storage, the way container sections are mapped
+struct Saved {
+  std::vector<uint64_t> words;
+  size_t size = 0;
+
+  explicit Saved(hash::mphf& phf) {
+    std::vector<char> out;
+    phf.save(out);
+    size = out.size();
+    words.resize((out.size() + 7) / 8);
+    std::memcpy(words.data(), out.data(), out.size());
+  }
+  std::span<const uint8_t> bytes() const { return {reinterpret_cast<const uint8_t*>(words.data()), size}; }
+};
+
+// every key gets its own slot below the key count, the same from a loaded copy, from hash_many and from a build on
+// several threads
+void check_phf(const std::vector<std::string>& key_strings) {
+  const std::vector<std::string_view> keys(key_strings.begin(), key_strings.end());
+  hash::mphf phf;
+  phf.build(keys);
+
+  std::vector<uint64_t> slots(keys.size());
+  std::vector<uint8_t> used(keys.size());
+  bool bijective = true;
+  for (size_t i = 0; i < keys.size(); i++) {
+    slots[i] = phf(keys[i]);
+    if (slots[i] >= keys.size() || used[slots[i]]) {
+      bijective = false;
+      break;
+    }
+    used[slots[i]] = 1;
+  }
+  CHECK(bijective);
+
+  std::vector<uint64_t> many(keys.size());
+  phf.hash_many(keys, many);
+  CHECK(many == slots);
+
+  const hash::phf_lookup lookup = phf.lookup();
+  hash::mphf moved = std::move(phf);
+  bool lookup_matches = true;
+  for (size_t i = 0; i < keys.size(); i++) {
+    lookup_matches = lookup_matches && lookup(moved, keys[i]) == slots[i] && moved(keys[i]) == slots[i];
+  }
+  CHECK(lookup_matches);
+
+  const Saved saved(moved);
+  hash::mphf loaded;
+  CHECK(loaded.load(saved.bytes()));
+  CHECK(loaded.type() == moved.type());
+  std::vector<uint64_t> loaded_slots(keys.size());
+  loaded.hash_many(keys, loaded_slots);
+  CHECK(loaded_slots == slots);
+
+  hash::mphf parallel;
+  parallel.build(keys, 4);
+  const Saved parallel_saved(parallel);
+  CHECK(parallel_saved.words == saved.words);
+}
+
+std::vector<std::string> numbered(size_t count, std::string_view prefix) {
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < count; i++) {
+    keys.push_back(std::string(prefix) + std::to_string(i));
+  }
+  return keys;
+}
+
+void test_sizes() {
+  // around the partition size and across several partitions
+  for (size_t count : {0, 1, 2, 3, 100, 65535, 65536, 65537, 300000}) {
+    check_phf(numbered(count, "key"));
+  }
+}
+
+void test_adversarial_keys() {
+  // long shared prefixes, keys that differ in one byte and keys with nul bytes
+  check_phf(numbered(100000, std::string(1000, 'x')));
+  std::vector<std::string> keys = {""};
+  for (int c = 1; c < 256; c++) {
+    keys.push_back(std::string(1, static_cast<char>(c)));
+    keys.push_back(std::string(4096, 'a') + static_cast<char>(c));
+    keys.push_back(std::string("\0\0", 2) + static_cast<char>(c));
+  }
+  check_phf(keys);
+  std::vector<std::string> binary;
+  for (uint32_t i = 0; i < 200000; i++) {
+    binary.emplace_back(reinterpret_cast<const char*>(&i), sizeof(i));
+  }
+  check_phf(binary);
+}
+
+void test_rejects_invalid_data() {
+  const std::vector<std::string> key_strings = numbered(200000, "key");
+  const std::vector<std::string_view> keys(key_strings.begin(), key_strings.end());
+  hash::mphf phf;
+  phf.build(keys);
+  const Saved saved(phf);
+  hash::mphf loaded;
+
+  CHECK(!loaded.load({}));
+  for (size_t size : {size_t{8}, size_t{48}, size_t{100}, saved.size - 8}) {
+    CHECK(!loaded.load(saved.bytes().first(size)));
+  }
+  std::vector<uint64_t> shifted(saved.words.size() + 1);
+  std::memcpy(reinterpret_cast<uint8_t*>(shifted.data()) + 1, saved.words.data(), saved.size);
+  CHECK(!loaded.load({reinterpret_cast<const uint8_t*>(shifted.data()) + 1, saved.size}));
+
+  // header words: type, seed, key count, partition count, pilot count and free slot count, then the partitions
+  auto corrupt = [&](size_t word, uint64_t value) {
+    Saved copy = saved;
+    copy.words[word] = value;
+    return !loaded.load(copy.bytes());
+  };
+  CHECK(corrupt(0, 2));
+  CHECK(corrupt(3, 0));
+  CHECK(corrupt(3, UINT64_MAX / 64));
+  CHECK(corrupt(4, UINT64_MAX));
+  CHECK(corrupt(5, UINT64_MAX));
+  // base, key count, table size, bucket count, seed, pilot begin and free begin of the first partition
+  CHECK(corrupt(6, UINT64_MAX));
+  CHECK(corrupt(7, UINT64_MAX));
+  CHECK(corrupt(8, 0));
+  CHECK(corrupt(9, 0));
+  CHECK(corrupt(9, UINT64_MAX));
+  CHECK(corrupt(11, UINT64_MAX));
+  CHECK(corrupt(12, UINT64_MAX));
+  CHECK(!corrupt(10, 1));
+  CHECK(loaded.load(saved.bytes()));
+}
+}
+
+int main() {
+  test_sizes();
+  test_adversarial_keys();
+  test_rejects_invalid_data();
+  return check_failures == 0 ? 0 : 1;
+}
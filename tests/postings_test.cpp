@@ -0,0 +1,138 @@
+#include "postings/postings.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <map>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "check.hpp"
+
+namespace {
+using Groups = std::vector<std::pair<std::string, std::vector<uint64_t>>>;
+
+// scratch directory for spilled runs, removed with everything in it
+struct TempDir {
+  std::filesystem::path path;
+
+  TempDir() : path(std::filesystem::temp_directory_path() / "hoshidicts_postings_test") {
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+
+  size_t file_count() const {
+    return static_cast<size_t>(std::distance(std::filesystem::directory_iterator(path), {}));
+  }
+};
+
+Groups finish(postings::Builder& builder) {
+  Groups out;
+  builder.finish([&](std::string_view key, std::span<const uint64_t> offsets) {
+    out.emplace_back(std::string(key), std::vector<uint64_t>(offsets.begin(), offsets.end()));
+  });
+  return out;
+}
+
+bool keys_match(const postings::Builder& builder, const Groups& groups) {
+  if (builder.keys().size() != groups.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < groups.size(); i++) {
+    if (builder.keys()[i] != groups[i].first) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// random keys with ascending offsets, the same groups come out in memory, from a few runs and from enough runs to
+// need more than one merge pass
+void test_spill_matches_in_memory() {
+  TempDir dir;
+  std::mt19937 rng(1);
+  std::vector<std::string> keys;
+  std::map<std::string, std::vector<uint64_t>> expected_groups;
+  for (uint64_t offset = 0; offset < 40000; offset++) {
+    keys.push_back("key" + std::to_string(rng() % 3000));
+    expected_groups[keys.back()].push_back(offset);
+  }
+  const Groups expected(expected_groups.begin(), expected_groups.end());
+
+  for (size_t budget : {0, 1 << 16, 512}) {
+    for (bool keep_keys : {true, false}) {
+      {
+        postings::Builder builder(dir.path / "postings", budget, keep_keys);
+        CHECK(builder.empty());
+        for (size_t i = 0; i < keys.size(); i++) {
+          builder.add(keys[i], i);
+        }
+        CHECK(!builder.empty());
+        const size_t runs = dir.file_count();
+        if (budget == 0) {
+          CHECK(runs == 0);
+        } else if (budget == 512) {
+          CHECK(runs > 64);
+        } else {
+          CHECK(runs > 1 && runs <= 64);
+        }
+
+        CHECK(finish(builder) == expected);
+        CHECK(keep_keys ? keys_match(builder, expected) : builder.keys().empty());
+        // merge passes remove the runs they merged, only the last pass and the key list are left
+        CHECK(dir.file_count() <= 65);
+      }
+      CHECK(dir.file_count() == 0);
+    }
+  }
+}
+
+// keys up to the u16 key length survive a spill, longer keys are rejected
+void test_key_lengths() {
+  TempDir dir;
+  postings::Builder builder(dir.path / "postings", 1024);
+  const std::string longest(postings::MAX_KEY_SIZE, 'x');
+  builder.add(longest, 0);
+  builder.add("", 1);
+  builder.add(longest, 2);
+  bool thrown = false;
+  try {
+    builder.add(std::string(postings::MAX_KEY_SIZE + 1, 'x'), 3);
+  } catch (const std::length_error&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  builder.add("", 4);
+
+  const Groups expected = {{"", {1, 4}}, {longest, {0, 2}}};
+  CHECK(finish(builder) == expected);
+  CHECK(keys_match(builder, expected));
+}
+
+void test_empty() {
+  TempDir dir;
+  for (size_t budget : {0, 512}) {
+    postings::Builder builder(dir.path / "postings", budget);
+    CHECK(builder.empty());
+    CHECK(finish(builder).empty());
+    CHECK(builder.keys().empty());
+  }
+  CHECK(dir.file_count() == 0);
+}
+}
+
+int main() {
+  test_spill_matches_in_memory();
+  test_key_lengths();
+  test_empty();
+  return check_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+#include "hoshidicts/query.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "check.hpp"
+#include "container/container.hpp"
+#include "hash/hash.hpp"
+#include "hoshidicts/importer.hpp"
+
+namespace {
+// scratch directory for dictionary sources and imports, removed with everything in it
+struct TempDir {
+  std::filesystem::path path;
+
+  TempDir() : path(std::filesystem::temp_directory_path() / "hoshidicts_query_test") {
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+};
+
+void write_file(const std::filesystem::path& path, std::string_view content) {
+  std::ofstream(path, std::ios::binary).write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+// imports an extracted yomitan dictionary written from the given banks into output, returns the path of the imported
+// file
+std::string import_dict(const TempDir& dir, const std::string& title, const std::string& term_bank,
+                        const std::string& meta_bank, const ImportOptions& options = {},
+                        const std::string& output = "out") {
+  const auto source = dir.path / ("source_" + output + "_" + title);
+  std::filesystem::create_directories(source);
+  write_file(source / "index.json", R"({"title":")" + title + R"(","revision":"1","format":3})");
+  if (!term_bank.empty()) {
+    write_file(source / "term_bank_1.json", term_bank);
+  }
+  if (!meta_bank.empty()) {
+    write_file(source / "term_meta_bank_1.json", meta_bank);
+  }
+  const ImportResult result = dictionary_importer::import(source.string(), (dir.path / output).string(), options);
+  CHECK(result.success);
+  return (dir.path / output / (title + ".hoshidict")).string();
+}
+
+std::string term(std::string_view expression, std::string_view glossary) {
+  return R"([")" + std::string(expression) + R"(","",null,"",0,[")" + std::string(glossary) + R"("],1,""])";
+}
+
+std::string frequency(std::string_view expression, int value) {
+  return R"([")" + std::string(expression) + R"(","freq",)" + std::to_string(value) + "]";
+}
+
+std::string bank(const std::vector<std::string>& entries) {
+  std::string out = "[";
+  for (size_t i = 0; i < entries.size(); i++) {
+    out += (i == 0 ? "" : ",") + entries[i];
+  }
+  return out + "]";
+}
+
+std::vector<std::string> expressions(const std::vector<TermResult>& terms) {
+  std::vector<std::string> out;
+  for (const auto& term : terms) {
+    out.push_back(term.expression);
+  }
+  return out;
+}
+
+// every matching term is ranked, including the ones sorting after many others by key
+void test_search_glossary_ranks_every_match() {
+  TempDir dir;
+  std::vector<std::string> terms;
+  char expression[16];
+  for (int i = 0; i < 12000; i++) {
+    std::snprintf(expression, sizeof(expression), "t%05d", i);
+    terms.push_back(term(expression, i % 2 == 0 ? "common word" : "common thing"));
+  }
+  const std::string term_path = import_dict(dir, "terms", bank(terms), "", ImportOptions{.glossary_index = true});
+  const std::string freq_path =
+      import_dict(dir, "freq", "", bank({frequency("t11998", 1), frequency("t11996", 2), frequency("t00001", 3)}));
+
+  DictionaryQuery query;
+  query.add_term_dict(term_path);
+  query.add_freq_dict(freq_path);
+  CHECK(expressions(query.search_glossary("common word", 2, false)) == (std::vector<std::string>{"t11998", "t11996"}));
+  CHECK(expressions(query.search_glossary("common", 3, false)) ==
+        (std::vector<std::string>{"t11998", "t11996", "t00001"}));
+  // unranked terms follow in key order
+  CHECK(expressions(query.search_glossary("thing", 2, false)) == (std::vector<std::string>{"t00001", "t00003"}));
+  CHECK(query.search_glossary("word", 100000, false).size() == 6000);
+  CHECK(query.search_glossary("missing", 10, false).empty());
+}
+
+// frequency dictionaries sharing a title keep their own rank and their own entries
+void test_frequency_dicts_with_same_title() {
+  TempDir dir;
+  const std::string term_path =
+      import_dict(dir, "terms", bank({term("x", "common word"), term("y", "common word"), term("w", "other")}), "",
+                  ImportOptions{.glossary_index = true});
+  const std::string first_path = import_dict(dir, "freq", "", bank({frequency("w", 3)}), {}, "first");
+  const std::string other_path = import_dict(dir, "other", "", bank({frequency("y", 100)}));
+  const std::string second_path =
+      import_dict(dir, "freq", "", bank({frequency("x", 1), frequency("w", 4)}), {}, "second");
+
+  DictionaryQuery query;
+  query.add_term_dict(term_path);
+  query.add_freq_dict(first_path);
+  query.add_freq_dict(other_path);
+  query.add_freq_dict(second_path);
+  // x only has a frequency in the second dictionary titled freq, so it ranks after y
+  CHECK(expressions(query.search_glossary("common", 2, false)) == (std::vector<std::string>{"y", "x"}));
+
+  const auto results = query.query("w");
+  CHECK(results.size() == 1);
+  if (results.size() == 1) {
+    const auto& frequencies = results[0].frequencies;
+    CHECK(frequencies.size() == 2);
+    CHECK(frequencies.size() == 2 && frequencies[0].dict_name == "freq" && frequencies[1].dict_name == "freq" &&
+          frequencies[0].frequencies.size() == 1 && frequencies[0].frequencies[0].value == 3 &&
+          frequencies[1].frequencies.size() == 1 && frequencies[1].frequencies[0].value == 4);
+  }
+}
+
+// keys of an imported dictionary are found through its key index, keys missing from it are rejected
+void test_key_index_round_trip() {
+  TempDir dir;
+  std::vector<std::string> present;
+  std::vector<std::string> terms;
+  std::vector<std::string> more_terms;
+  for (int i = 0; i < 3000; i++) {
+    present.push_back("word" + std::to_string(i));
+    terms.push_back(term(present.back(), "gloss " + std::to_string(i)));
+    if (i % 2 == 0) {
+      more_terms.push_back(term(present.back(), "more " + std::to_string(i)));
+    }
+  }
+  std::vector<std::string> absent = {"", "word", "word1 ", "Word1", "word01"};
+  for (int i = 3000; i < 6000; i++) {
+    absent.push_back("word" + std::to_string(i));
+  }
+  const std::string path = import_dict(dir, "words", bank(terms), "");
+  const std::string more_path = import_dict(dir, "more", bank(more_terms), "");
+
+  // the slot of a missing key belongs to another key, whose fingerprint has to reject it
+  container::Reader file;
+  CHECK(file.open(path));
+  hash::mphf phf;
+  CHECK(phf.load(file.section(container::Section::term_phf)));
+  const auto offsets = file.section(container::Section::term_offsets);
+  CHECK(offsets.size() == present.size() * sizeof(uint64_t));
+  auto stored_fingerprint = [&](std::string_view key) {
+    const uint64_t slot = phf(key);
+    uint64_t entry = 0;
+    if (slot < offsets.size() / sizeof(uint64_t)) {
+      std::memcpy(&entry, offsets.data() + slot * sizeof(uint64_t), sizeof(entry));
+    }
+    return entry & ~hash::SLOT_OFFSET_MASK;
+  };
+  size_t matching = 0;
+  for (const auto& key : present) {
+    matching += stored_fingerprint(key) == hash::slot_fingerprint(key);
+  }
+  CHECK(matching == present.size());
+  size_t rejected = 0;
+  for (const auto& key : absent) {
+    rejected += stored_fingerprint(key) != hash::slot_fingerprint(key);
+  }
+  CHECK(rejected == absent.size());
+
+  DictionaryQuery query;
+  query.add_term_dict(path);
+  query.add_term_dict(more_path);
+  for (bool merged : {false, true}) {
+    query.set_merged_index(merged);
+    bool found = true;
+    for (int i = 0; i < 3000; i++) {
+      const auto results = query.query(present[i]);
+      const size_t dicts = i % 2 == 0 ? 2 : 1;
+      found = found && results.size() == 1 && results[0].expression == present[i] &&
+              results[0].glossaries.size() == dicts &&
+              results[0].glossaries[0].glossary.find("gloss " + std::to_string(i)) != std::string::npos;
+    }
+    CHECK(found);
+    bool missing = true;
+    for (const auto& key : absent) {
+      missing = missing && query.query(key, false).empty();
+    }
+    CHECK(missing);
+
+    std::vector<std::string_view> batch(present.begin(), present.end());
+    batch.insert(batch.end(), absent.begin(), absent.end());
+    const auto batch_results = query.query_batch(batch, false);
+    CHECK(batch_results.size() == batch.size());
+    bool batch_matches = true;
+    for (size_t i = 0; i < batch.size() && i < batch_results.size(); i++) {
+      batch_matches = batch_matches && batch_results[i].empty() == (i >= present.size());
+    }
+    CHECK(batch_matches);
+  }
+}
+}
+
+int main() {
+  test_search_glossary_ranks_every_match();
+  test_frequency_dicts_with_same_title();
+  test_key_index_round_trip();
+  return check_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+#include "sorted_keys/sorted_keys.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "check.hpp"
+
+namespace {
+struct Keys {
+  std::vector<std::string> keys;
+  std::vector<uint64_t> values;
+  std::vector<char> data;
+  sorted_keys::Reader reader;
+
+  explicit Keys(std::vector<std::string> sorted) : keys(std::move(sorted)) {
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    for (size_t i = 0; i < keys.size(); i++) {
+      values.push_back(i * 3 + 1);
+    }
+    sorted_keys::write(views, values, data);
+    CHECK(reader.load({reinterpret_cast<const uint8_t*>(data.data()), data.size()}));
+  }
+
+  std::vector<std::pair<std::string, uint64_t>> scan(std::string_view first, size_t limit) const {
+    std::vector<std::pair<std::string, uint64_t>> out;
+    reader.scan(first, [&](std::string_view key, uint64_t value) {
+      out.emplace_back(key, value);
+      return out.size() < limit;
+    });
+    return out;
+  }
+
+  // what scan should return, computed from the sorted input
+  std::vector<std::pair<std::string, uint64_t>> expected(std::string_view first, size_t limit) const {
+    std::vector<std::pair<std::string, uint64_t>> out;
+    for (auto i = static_cast<size_t>(std::ranges::lower_bound(keys, first) - keys.begin());
+         i < keys.size() && out.size() < limit; i++) {
+      out.emplace_back(keys[i], values[i]);
+    }
+    return out;
+  }
+};
+
+void test_empty() {
+  Keys keys({});
+  CHECK(keys.reader.empty());
+  CHECK(keys.scan("", 10).empty());
+  std::string key;
+  uint64_t value = 0;
+  CHECK(!keys.reader.at(0, key, value));
+}
+
+void test_rejects_truncated_data() {
+  sorted_keys::Reader reader;
+  const uint8_t data[8] = {};
+  CHECK(!reader.load({data, sizeof(data)}));
+}
+
+// the streamed buckets span several flushes, the trailer still finds every key
+void test_streamed_writer() {
+  std::vector<std::string> sorted;
+  for (int i = 0; i < 20000; i++) {
+    sorted.push_back("key" + std::to_string(i));
+  }
+  std::ranges::sort(sorted);
+  Keys keys(sorted);
+  CHECK(keys.reader.size() == sorted.size());
+  CHECK(keys.scan("", sorted.size()) == keys.expected("", sorted.size()));
+  CHECK(keys.scan("key1999", 20) == keys.expected("key1999", 20));
+
+  // a corrupt trailer is rejected
+  std::vector<char> data = keys.data;
+  data[data.size() - 8]++;
+  sorted_keys::Reader reader;
+  CHECK(!reader.load({reinterpret_cast<const uint8_t*>(data.data()), data.size()}));
+}
+
+void test_scan_and_at() {
+  std::vector<std::string> sorted;
+  for (int i = 0; i < 1000; i++) {
+    sorted.push_back("k" + std::to_string(i * 7));
+  }
+  sorted.push_back("日本");
+  sorted.push_back("日本語");
+  std::ranges::sort(sorted);
+  Keys keys(sorted);
+  CHECK(keys.reader.size() == sorted.size());
+
+  for (std::string_view first : {"", "k", "k35", "k350", "k9", "k99", "k1000", "z", "日", "日本語", "\xff"}) {
+    CHECK(keys.scan(first, 5) == keys.expected(first, 5));
+  }
+  CHECK(keys.scan("", sorted.size() + 1) == keys.expected("", sorted.size() + 1));
+
+  for (size_t i = 0; i < sorted.size(); i++) {
+    std::string key;
+    uint64_t value = 0;
+    CHECK(keys.reader.at(i, key, value) && key == sorted[i] && value == keys.values[i]);
+  }
+  std::string key;
+  uint64_t value = 0;
+  CHECK(!keys.reader.at(sorted.size(), key, value));
+}
+
+// the suffix index stores equal keys once per value. runs of a key longer than a bucket start in the bucket before
+// the first head equal to the key, scan has to find the first of them
+void test_duplicates_across_buckets() {
+  std::vector<std::string> sorted;
+  for (int i = 0; i < 100; i++) {
+    for (int j = 0; j < (i % 5) * 9 + 1; j++) {
+      sorted.push_back("k" + std::to_string(i));
+    }
+  }
+  std::ranges::sort(sorted);
+  Keys keys(sorted);
+
+  for (int i = 0; i < 100; i++) {
+    const std::string first = "k" + std::to_string(i);
+    std::vector<uint64_t> found;
+    keys.reader.scan(first, [&](std::string_view key, uint64_t value) {
+      if (key != first) {
+        return false;
+      }
+      found.push_back(value);
+      return true;
+    });
+    std::vector<uint64_t> expected;
+    for (size_t k = 0; k < sorted.size(); k++) {
+      if (sorted[k] == first) {
+        expected.push_back(keys.values[k]);
+      }
+    }
+    CHECK(found == expected);
+  }
+}
+
+// every head equal to the scanned key: with <= in the head search the scan would start after them
+void test_bucket_heads_equal_to_first() {
+  std::vector<std::string> sorted(10, "a");
+  sorted.insert(sorted.end(), 60, "b");
+  sorted.insert(sorted.end(), 5, "c");
+  Keys keys(sorted);
+  CHECK(keys.scan("b", 100) == keys.expected("b", 100));
+  CHECK(keys.scan("b", 100).size() == 65);
+  CHECK(keys.scan("a", 1) == keys.expected("a", 1));
+  CHECK(keys.scan("c", 100).size() == 5);
+  CHECK(keys.scan("bb", 100) == keys.expected("bb", 100));
+}
+
+// shared prefixes longer than the previous key must not read past it
+void test_front_coding() {
+  Keys keys({"a", "ab", "abc", "abcd", "abd", "b", "ba", "日", "日本", "日本語", "日本酒"});
+  CHECK(keys.scan("", 100) == keys.expected("", 100));
+  CHECK(keys.scan("abc", 3) == keys.expected("abc", 3));
+  CHECK(keys.scan("日本", 100) == keys.expected("日本", 100));
+}
+}
+
+int main() {
+  test_empty();
+  test_rejects_truncated_data();
+  test_scan_and_at();
+  test_streamed_writer();
+  test_duplicates_across_buckets();
+  test_bucket_heads_equal_to_first();
+  test_front_coding();
+  return check_failures == 0 ? 0 : 1;
+}
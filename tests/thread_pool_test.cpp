@@ -0,0 +1,103 @@
+#include "thread_pool/thread_pool.hpp"
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "check.hpp"
+
+namespace {
+// awaits its children at every level, which only finishes if awaiting tasks run their own children
+long fib(thread_pool::Pool& pool, int n) {
+  if (n < 2) {
+    return n;
+  }
+  auto left = pool.submit([&pool, n]() { return fib(pool, n - 1); });
+  auto right = pool.submit([&pool, n]() { return fib(pool, n - 2); });
+  return pool.await(left) + pool.await(right);
+}
+
+void test_submit() {
+  for (size_t threads : {1, 4}) {
+    thread_pool::Pool pool(threads);
+    CHECK(pool.size() == threads);
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 1000; i++) {
+      futures.push_back(pool.submit([i]() { return i * 2; }));
+    }
+    bool results = true;
+    for (int i = 0; i < 1000; i++) {
+      results = results && pool.await(futures[i]) == i * 2;
+    }
+    CHECK(results);
+  }
+}
+
+void test_nested_await() {
+  for (size_t threads : {1, 2, 4}) {
+    thread_pool::Pool pool(threads);
+    auto result = pool.submit([&pool]() { return fib(pool, 16); });
+    CHECK(pool.await(result) == 987);
+  }
+}
+
+// while a task awaits its children, it doesn't pick up unrelated tasks that could block it for longer
+void test_await_runs_only_children() {
+  thread_pool::Pool pool(1);
+  std::promise<void> started;
+  std::promise<void> other_submitted;
+  std::atomic<bool> other_ran = false;
+  auto parent = pool.submit([&]() {
+    started.set_value();
+    other_submitted.get_future().wait();
+    auto child = pool.submit([]() { return 1; });
+    pool.await(child);
+    return other_ran.load();
+  });
+  started.get_future().wait();
+  auto other = pool.submit([&]() { other_ran = true; });
+  other_submitted.set_value();
+  CHECK(!pool.await(parent));
+  pool.await(other);
+  CHECK(other_ran);
+}
+
+void test_exceptions() {
+  thread_pool::Pool pool(2);
+  auto failing = pool.submit([]() -> int { throw std::runtime_error("task failed"); });
+  bool thrown = false;
+  try {
+    pool.await(failing);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  auto next = pool.submit([]() { return 1; });
+  CHECK(pool.await(next) == 1);
+}
+
+// the destructor runs every queued task before joining the workers
+void test_destructor_drains() {
+  std::atomic<int> count = 0;
+  {
+    thread_pool::Pool pool(2);
+    for (int i = 0; i < 500; i++) {
+      pool.submit([&count, &pool]() {
+        count++;
+        pool.submit([&count]() { count++; });
+      });
+    }
+  }
+  CHECK(count == 1000);
+}
+}
+
+int main() {
+  test_submit();
+  test_nested_await();
+  test_await_runs_only_children();
+  test_exceptions();
+  test_destructor_drains();
+  return check_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+#include "wildcard/wildcard.hpp"
+
+#include "check.hpp"
+
+namespace {
+void test_literals() {
+  CHECK(wildcard::match("", ""));
+  CHECK(wildcard::match("abc", "abc"));
+  CHECK(!wildcard::match("abc", "abd"));
+  CHECK(!wildcard::match("abc", "ab"));
+  CHECK(!wildcard::match("ab", "abc"));
+  CHECK(wildcard::match("目的", "目的"));
+}
+
+void test_question_mark() {
+  CHECK(wildcard::match("a?c", "abc"));
+  CHECK(!wildcard::match("a?c", "ac"));
+  // ? is one code point, not one byte
+  CHECK(wildcard::match("?", "語"));
+  CHECK(!wildcard::match("??", "語"));
+  CHECK(!wildcard::match("???", "語"));
+  CHECK(wildcard::match("?的", "目的"));
+  CHECK(!wildcard::match("?的", "目目的"));
+  CHECK(wildcard::match("日?語", "日本語"));
+}
+
+void test_star() {
+  CHECK(wildcard::match("*", ""));
+  CHECK(wildcard::match("*", "日本語"));
+  CHECK(wildcard::match("**c", "abc"));
+  CHECK(wildcard::match("a*", "a"));
+  CHECK(wildcard::match("目*", "目的"));
+  CHECK(wildcard::match("*的", "目的"));
+  CHECK(!wildcard::match("*的", "的確"));
+  CHECK(wildcard::match("*的*", "的確"));
+  CHECK(wildcard::match("a*b*c", "axxbyyc"));
+  CHECK(!wildcard::match("a*b*c", "axxbyy"));
+}
+
+// a star that backtracks has to resume at code point boundaries, or ? and literals would match inside a character
+void test_star_backtracking_multibyte() {
+  CHECK(wildcard::match("*語", "日本語"));
+  CHECK(wildcard::match("日*語", "日本語語"));
+  CHECK(wildcard::match("*本*語", "日本日本語"));
+  CHECK(!wildcard::match("*本*語", "日語本"));
+  CHECK(wildcard::match("*?", "語"));
+  CHECK(!wildcard::match("?*?", "語"));
+  CHECK(wildcard::match("*??", "日本"));
+  CHECK(!wildcard::match("*???", "日本"));
+  CHECK(wildcard::match("*?語", "日本語"));
+  CHECK(!wildcard::match("*?語", "語"));
+  CHECK(wildcard::match("*a?", "日a語"));
+  CHECK(!wildcard::match("*a?", "日a語本"));
+  CHECK(wildcard::match("*a*?", "日a語本"));
+}
+
+void test_longest_literal() {
+  CHECK(wildcard::longest_literal("") == "");
+  CHECK(wildcard::longest_literal("*") == "");
+  CHECK(wildcard::longest_literal("abc") == "abc");
+  CHECK(wildcard::longest_literal("*的*") == "的");
+  CHECK(wildcard::longest_literal("ab*cde?f") == "cde");
+  // measured in bytes, the anchor with the fewest candidates
+  CHECK(wildcard::longest_literal("日*本語") == "本語");
+  // the first of equally long runs
+  CHECK(wildcard::longest_literal("ab*cd") == "ab");
+  CHECK(wildcard::longest_literal("?ab?") == "ab");
+}
+}
+
+int main() {
+  test_literals();
+  test_question_mark();
+  test_star();
+  test_star_backtracking_multibyte();
+  test_longest_literal();
+  return check_failures == 0 ? 0 : 1;
+}